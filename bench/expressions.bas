@@ -0,0 +1,10 @@
+10 REM Deep expressions stress test
+20 A = 1
+30 I = 0
+40 B = ((((A + 1) * 3 - (A / 2)) % 7 + ((A * A) & 255) ^ (A | 3)) - -A) * 2
+50 C = (((B % 13) * ((A + B) % 17)) + (((B ^ A) & 0xFF) | ((A * 3) % 11))) / (1 + (A & 7))
+60 D = !(!(A + B) + C) - (-(-(C * 2))) + ((((((A + B + C) % 97))))) * (B - C) % 1000
+70 A = (A * 1103 + 12345 + D - D) % 65536
+80 I = I + 1
+90 IF I < 500 THEN GOTO 40
+100 PRINT A : " " : B : " " : C : " " : D
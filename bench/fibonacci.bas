@@ -0,0 +1,10 @@
+10 REM Fibonacci Sequence
+20 A = 1
+30 B = 1
+40 C = 40
+50 PRINT A
+60 D = A
+70 A = A + B
+80 B = D
+90 C = C - 1
+100 IF C > 0 THEN GOTO 50
@@ -0,0 +1,11 @@
+10 REM Nested FOR loops and GOSUB calls, sums of the multiplication table
+20 S = 0
+30 FOR I = 1 TO 40
+40 FOR J = 1 TO 40
+50 GOSUB 100
+60 NEXT J
+70 NEXT I
+80 PRINT S
+90 END
+100 S = S + I * J
+110 RETURN
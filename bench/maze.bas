@@ -0,0 +1,1007 @@
+10 REM GOTO maze, every line jumps to a random other line
+20 C = 0
+30 GOTO 4360
+90 C = C + 1
+95 IF C < 20 THEN GOTO 4360
+96 PRINT C
+97 END
+100 GOTO 3265
+105 GOTO 1870
+110 GOTO 4025
+115 GOTO 2300
+120 GOTO 3620
+125 GOTO 3830
+130 GOTO 3400
+135 GOTO 2205
+140 GOTO 765
+145 GOTO 2870
+150 GOTO 235
+155 GOTO 5040
+160 GOTO 1260
+165 GOTO 3625
+170 GOTO 2415
+175 GOTO 4515
+180 GOTO 2845
+185 GOTO 525
+190 GOTO 1250
+195 GOTO 4130
+200 GOTO 3820
+205 GOTO 2310
+210 GOTO 255
+215 GOTO 1780
+220 GOTO 680
+225 GOTO 1545
+230 GOTO 210
+235 GOTO 3085
+240 GOTO 3170
+245 GOTO 2595
+250 GOTO 3850
+255 GOTO 1725
+260 GOTO 2090
+265 GOTO 5065
+270 GOTO 3270
+275 GOTO 4465
+280 GOTO 845
+285 GOTO 3030
+290 GOTO 4260
+295 GOTO 1130
+300 GOTO 3720
+305 GOTO 430
+310 GOTO 4995
+315 GOTO 1620
+320 GOTO 2500
+325 GOTO 3675
+330 GOTO 4510
+335 GOTO 5025
+340 GOTO 1185
+345 GOTO 1180
+350 GOTO 1815
+355 GOTO 1705
+360 GOTO 3095
+365 GOTO 1330
+370 GOTO 880
+375 GOTO 3600
+380 GOTO 2020
+385 GOTO 2280
+390 GOTO 4090
+395 GOTO 2570
+400 GOTO 4700
+405 GOTO 640
+410 GOTO 1175
+415 GOTO 315
+420 GOTO 4010
+425 GOTO 5070
+430 GOTO 1300
+435 GOTO 545
+440 GOTO 4075
+445 GOTO 4960
+450 GOTO 4780
+455 GOTO 1585
+460 GOTO 3545
+465 GOTO 725
+470 GOTO 2180
+475 GOTO 825
+480 GOTO 3670
+485 GOTO 4680
+490 GOTO 4265
+495 GOTO 2375
+500 GOTO 4035
+505 GOTO 1040
+510 GOTO 3580
+515 GOTO 2995
+520 GOTO 4745
+525 GOTO 460
+530 GOTO 305
+535 GOTO 3355
+540 GOTO 2015
+545 GOTO 2065
+550 GOTO 115
+555 GOTO 4765
+560 GOTO 2390
+565 GOTO 1025
+570 GOTO 615
+575 GOTO 4140
+580 GOTO 1170
+585 GOTO 4965
+590 GOTO 4950
+595 GOTO 2005
+600 GOTO 395
+605 GOTO 1875
+610 GOTO 3385
+615 GOTO 1810
+620 GOTO 3125
+625 GOTO 3650
+630 GOTO 2620
+635 GOTO 3935
+640 GOTO 2735
+645 GOTO 840
+650 GOTO 2700
+655 GOTO 1420
+660 GOTO 4330
+665 GOTO 940
+670 GOTO 2430
+675 GOTO 1970
+680 GOTO 2525
+685 GOTO 1845
+690 GOTO 925
+695 GOTO 325
+700 GOTO 1405
+705 GOTO 3205
+710 GOTO 675
+715 GOTO 1615
+720 GOTO 175
+725 GOTO 2925
+730 GOTO 1805
+735 GOTO 810
+740 GOTO 1625
+745 GOTO 730
+750 GOTO 4870
+755 GOTO 2910
+760 GOTO 4240
+765 GOTO 1390
+770 GOTO 2820
+775 GOTO 3050
+780 GOTO 530
+785 GOTO 90
+790 GOTO 2980
+795 GOTO 3640
+800 GOTO 1770
+805 GOTO 4195
+810 GOTO 855
+815 GOTO 1445
+820 GOTO 5095
+825 GOTO 2195
+830 GOTO 3525
+835 GOTO 2880
+840 GOTO 595
+845 GOTO 2130
+850 GOTO 2045
+855 GOTO 4445
+860 GOTO 895
+865 GOTO 2630
+870 GOTO 3465
+875 GOTO 3560
+880 GOTO 4790
+885 GOTO 2890
+890 GOTO 2395
+895 GOTO 4925
+900 GOTO 3840
+905 GOTO 2805
+910 GOTO 3945
+915 GOTO 955
+920 GOTO 3780
+925 GOTO 4920
+930 GOTO 1985
+935 GOTO 4085
+940 GOTO 3910
+945 GOTO 1295
+950 GOTO 965
+955 GOTO 455
+960 GOTO 970
+965 GOTO 780
+970 GOTO 3410
+975 GOTO 2455
+980 GOTO 1000
+985 GOTO 3500
+990 GOTO 1730
+995 GOTO 3845
+1000 GOTO 4270
+1005 GOTO 3350
+1010 GOTO 2535
+1015 GOTO 2055
+1020 GOTO 3310
+1025 GOTO 3090
+1030 GOTO 4175
+1035 GOTO 1425
+1040 GOTO 3480
+1045 GOTO 3295
+1050 GOTO 610
+1055 GOTO 3450
+1060 GOTO 2255
+1065 GOTO 4525
+1070 GOTO 3530
+1075 GOTO 4720
+1080 GOTO 990
+1085 GOTO 155
+1090 GOTO 4930
+1095 GOTO 2650
+1100 GOTO 600
+1105 GOTO 3300
+1110 GOTO 4305
+1115 GOTO 1670
+1120 GOTO 4045
+1125 GOTO 2035
+1130 GOTO 2750
+1135 GOTO 1890
+1140 GOTO 3145
+1145 GOTO 3165
+1150 GOTO 2970
+1155 GOTO 3785
+1160 GOTO 4750
+1165 GOTO 1750
+1170 GOTO 4135
+1175 GOTO 2770
+1180 GOTO 4535
+1185 GOTO 740
+1190 GOTO 2295
+1195 GOTO 575
+1200 GOTO 1380
+1205 GOTO 3610
+1210 GOTO 3120
+1215 GOTO 2565
+1220 GOTO 3565
+1225 GOTO 2885
+1230 GOTO 4740
+1235 GOTO 2800
+1240 GOTO 2405
+1245 GOTO 4120
+1250 GOTO 205
+1255 GOTO 3180
+1260 GOTO 2670
+1265 GOTO 3770
+1270 GOTO 5080
+1275 GOTO 240
+1280 GOTO 1865
+1285 GOTO 4560
+1290 GOTO 2930
+1295 GOTO 1135
+1300 GOTO 2825
+1305 GOTO 5060
+1310 GOTO 1480
+1315 GOTO 755
+1320 GOTO 775
+1325 GOTO 3895
+1330 GOTO 4665
+1335 GOTO 4975
+1340 GOTO 2555
+1345 GOTO 200
+1350 GOTO 570
+1355 GOTO 4660
+1360 GOTO 1115
+1365 GOTO 3975
+1370 GOTO 4185
+1375 GOTO 1535
+1380 GOTO 670
+1385 GOTO 1215
+1390 GOTO 2990
+1395 GOTO 655
+1400 GOTO 3195
+1405 GOTO 420
+1410 GOTO 3685
+1415 GOTO 1915
+1420 GOTO 1060
+1425 GOTO 1920
+1430 GOTO 380
+1435 GOTO 1950
+1440 GOTO 3765
+1445 GOTO 4730
+1450 GOTO 550
+1455 GOTO 4970
+1460 GOTO 2380
+1465 GOTO 515
+1470 GOTO 4895
+1475 GOTO 4785
+1480 GOTO 485
+1485 GOTO 3220
+1490 GOTO 3160
+1495 GOTO 3460
+1500 GOTO 2975
+1505 GOTO 3405
+1510 GOTO 4150
+1515 GOTO 2440
+1520 GOTO 4545
+1525 GOTO 3485
+1530 GOTO 3980
+1535 GOTO 3965
+1540 GOTO 2155
+1545 GOTO 1085
+1550 GOTO 1650
+1555 GOTO 3885
+1560 GOTO 1165
+1565 GOTO 4490
+1570 GOTO 4850
+1575 GOTO 3745
+1580 GOTO 2450
+1585 GOTO 4350
+1590 GOTO 3925
+1595 GOTO 3730
+1600 GOTO 2030
+1605 GOTO 4695
+1610 GOTO 4235
+1615 GOTO 4500
+1620 GOTO 4365
+1625 GOTO 400
+1630 GOTO 4880
+1635 GOTO 2370
+1640 GOTO 4335
+1645 GOTO 4115
+1650 GOTO 1070
+1655 GOTO 3605
+1660 GOTO 1530
+1665 GOTO 340
+1670 GOTO 3150
+1675 GOTO 320
+1680 GOTO 980
+1685 GOTO 490
+1690 GOTO 2575
+1695 GOTO 220
+1700 GOTO 2100
+1705 GOTO 750
+1710 GOTO 2540
+1715 GOTO 285
+1720 GOTO 425
+1725 GOTO 4715
+1730 GOTO 1105
+1735 GOTO 4620
+1740 GOTO 3045
+1745 GOTO 4555
+1750 GOTO 4540
+1755 GOTO 2465
+1760 GOTO 4320
+1765 GOTO 4550
+1770 GOTO 1960
+1775 GOTO 4800
+1780 GOTO 2950
+1785 GOTO 3005
+1790 GOTO 1370
+1795 GOTO 3235
+1800 GOTO 3900
+1805 GOTO 2305
+1810 GOTO 1355
+1815 GOTO 1030
+1820 GOTO 4355
+1825 GOTO 770
+1830 GOTO 1980
+1835 GOTO 790
+1840 GOTO 1830
+1845 GOTO 3690
+1850 GOTO 3255
+1855 GOTO 2075
+1860 GOTO 2730
+1865 GOTO 1290
+1870 GOTO 4580
+1875 GOTO 1125
+1880 GOTO 705
+1885 GOTO 1385
+1890 GOTO 4470
+1895 GOTO 520
+1900 GOTO 4480
+1905 GOTO 3055
+1910 GOTO 3585
+1915 GOTO 370
+1920 GOTO 4460
+1925 GOTO 2580
+1930 GOTO 2125
+1935 GOTO 4835
+1940 GOTO 4290
+1945 GOTO 1360
+1950 GOTO 4675
+1955 GOTO 1455
+1960 GOTO 1660
+1965 GOTO 2560
+1970 GOTO 2955
+1975 GOTO 985
+1980 GOTO 3990
+1985 GOTO 2210
+1990 GOTO 3305
+1995 GOTO 4625
+2000 GOTO 1850
+2005 GOTO 1825
+2010 GOTO 2250
+2015 GOTO 3875
+2020 GOTO 1015
+2025 GOTO 505
+2030 GOTO 2550
+2035 GOTO 3615
+2040 GOTO 3435
+2045 GOTO 470
+2050 GOTO 4610
+2055 GOTO 4455
+2060 GOTO 125
+2065 GOTO 870
+2070 GOTO 2585
+2075 GOTO 1695
+2080 GOTO 4565
+2085 GOTO 2830
+2090 GOTO 745
+2095 GOTO 4375
+2100 GOTO 5045
+2105 GOTO 4900
+2110 GOTO 2685
+2115 GOTO 3060
+2120 GOTO 4910
+2125 GOTO 4830
+2130 GOTO 190
+2135 GOTO 1365
+2140 GOTO 1700
+2145 GOTO 360
+2150 GOTO 3575
+2155 GOTO 3230
+2160 GOTO 585
+2165 GOTO 4180
+2170 GOTO 1285
+2175 GOTO 2840
+2180 GOTO 300
+2185 GOTO 1595
+2190 GOTO 835
+2195 GOTO 3595
+2200 GOTO 2715
+2205 GOTO 1430
+2210 GOTO 4635
+2215 GOTO 2680
+2220 GOTO 2165
+2225 GOTO 4735
+2230 GOTO 4905
+2235 GOTO 1415
+2240 GOTO 1110
+2245 GOTO 4605
+2250 GOTO 3130
+2255 GOTO 1855
+2260 GOTO 1205
+2265 GOTO 1655
+2270 GOTO 3025
+2275 GOTO 4795
+2280 GOTO 1150
+2285 GOTO 800
+2290 GOTO 2145
+2295 GOTO 1835
+2300 GOTO 695
+2305 GOTO 4200
+2310 GOTO 3200
+2315 GOTO 2095
+2320 GOTO 3070
+2325 GOTO 625
+2330 GOTO 2510
+2335 GOTO 2520
+2340 GOTO 5075
+2345 GOTO 540
+2350 GOTO 1760
+2355 GOTO 475
+2360 GOTO 495
+2365 GOTO 1255
+2370 GOTO 405
+2375 GOTO 1065
+2380 GOTO 3660
+2385 GOTO 4820
+2390 GOTO 555
+2395 GOTO 1940
+2400 GOTO 3995
+2405 GOTO 2740
+2410 GOTO 2610
+2415 GOTO 185
+2420 GOTO 1820
+2425 GOTO 1605
+2430 GOTO 1720
+2435 GOTO 2275
+2440 GOTO 4980
+2445 GOTO 1795
+2450 GOTO 5050
+2455 GOTO 4230
+2460 GOTO 2485
+2465 GOTO 3175
+2470 GOTO 3250
+2475 GOTO 1755
+2480 GOTO 1080
+2485 GOTO 4415
+2490 GOTO 1790
+2495 GOTO 1520
+2500 GOTO 250
+2505 GOTO 665
+2510 GOTO 2725
+2515 GOTO 2400
+2520 GOTO 2190
+2525 GOTO 2640
+2530 GOTO 1400
+2535 GOTO 3365
+2540 GOTO 3880
+2545 GOTO 4810
+2550 GOTO 4690
+2555 GOTO 275
+2560 GOTO 385
+2565 GOTO 2785
+2570 GOTO 4570
+2575 GOTO 4225
+2580 GOTO 2215
+2585 GOTO 735
+2590 GOTO 635
+2595 GOTO 580
+2600 GOTO 3190
+2605 GOTO 1995
+2610 GOTO 905
+2615 GOTO 4505
+2620 GOTO 1090
+2625 GOTO 1935
+2630 GOTO 2545
+2635 GOTO 700
+2640 GOTO 1745
+2645 GOTO 2270
+2650 GOTO 295
+2655 GOTO 4615
+2660 GOTO 3740
+2665 GOTO 2760
+2670 GOTO 960
+2675 GOTO 3855
+2680 GOTO 4380
+2685 GOTO 4430
+2690 GOTO 3705
+2695 GOTO 4860
+2700 GOTO 3495
+2705 GOTO 3285
+2710 GOTO 3835
+2715 GOTO 3870
+2720 GOTO 3890
+2725 GOTO 3940
+2730 GOTO 2170
+2735 GOTO 1690
+2740 GOTO 3655
+2745 GOTO 1020
+2750 GOTO 4815
+2755 GOTO 760
+2760 GOTO 885
+2765 GOTO 935
+2770 GOTO 1010
+2775 GOTO 415
+2780 GOTO 1240
+2785 GOTO 2150
+2790 GOTO 2665
+2795 GOTO 3360
+2800 GOTO 5005
+2805 GOTO 180
+2810 GOTO 2435
+2815 GOTO 225
+2820 GOTO 1320
+2825 GOTO 4940
+2830 GOTO 4530
+2835 GOTO 4015
+2840 GOTO 120
+2845 GOTO 5090
+2850 GOTO 4475
+2855 GOTO 105
+2860 GOTO 1120
+2865 GOTO 2855
+2870 GOTO 3425
+2875 GOTO 3860
+2880 GOTO 1715
+2885 GOTO 4250
+2890 GOTO 2625
+2895 GOTO 4310
+2900 GOTO 5030
+2905 GOTO 1975
+2910 GOTO 1195
+2915 GOTO 1005
+2920 GOTO 565
+2925 GOTO 1410
+2930 GOTO 5055
+2935 GOTO 3015
+2940 GOTO 1565
+2945 GOTO 4385
+2950 GOTO 4155
+2955 GOTO 4595
+2960 GOTO 1305
+2965 GOTO 4775
+2970 GOTO 4080
+2975 GOTO 1140
+2980 GOTO 1775
+2985 GOTO 1610
+2990 GOTO 4770
+2995 GOTO 1245
+3000 GOTO 4420
+3005 GOTO 875
+3010 GOTO 785
+3015 GOTO 1965
+3020 GOTO 3665
+3025 GOTO 270
+3030 GOTO 2290
+3035 GOTO 4255
+3040 GOTO 1450
+3045 GOTO 3555
+3050 GOTO 890
+3055 GOTO 1860
+3060 GOTO 3135
+3065 GOTO 3440
+3070 GOTO 435
+3075 GOTO 2135
+3080 GOTO 3445
+3085 GOTO 4915
+3090 GOTO 2915
+3095 GOTO 3535
+3100 GOTO 2645
+3105 GOTO 1550
+3110 GOTO 4600
+3115 GOTO 2110
+3120 GOTO 290
+3125 GOTO 1270
+3130 GOTO 2420
+3135 GOTO 3245
+3140 GOTO 4210
+3145 GOTO 4760
+3150 GOTO 4890
+3155 GOTO 330
+3160 GOTO 2480
+3165 GOTO 1635
+3170 GOTO 2445
+3175 GOTO 135
+3180 GOTO 365
+3185 GOTO 3955
+3190 GOTO 3380
+3195 GOTO 2790
+3200 GOTO 5020
+3205 GOTO 4645
+3210 GOTO 2315
+3215 GOTO 4370
+3220 GOTO 1505
+3225 GOTO 1640
+3230 GOTO 1765
+3235 GOTO 4125
+3240 GOTO 1265
+3245 GOTO 4440
+3250 GOTO 2160
+3255 GOTO 410
+3260 GOTO 1055
+3265 GOTO 1885
+3270 GOTO 2265
+3275 GOTO 1435
+3280 GOTO 1200
+3285 GOTO 975
+3290 GOTO 2865
+3295 GOTO 660
+3300 GOTO 2105
+3305 GOTO 3865
+3310 GOTO 2490
+3315 GOTO 3825
+3320 GOTO 1050
+3325 GOTO 1225
+3330 GOTO 4325
+3335 GOTO 4160
+3340 GOTO 2360
+3345 GOTO 805
+3350 GOTO 1275
+3355 GOTO 2240
+3360 GOTO 355
+3365 GOTO 3810
+3370 GOTO 4450
+3375 GOTO 1310
+3380 GOTO 1590
+3385 GOTO 2945
+3390 GOTO 2775
+3395 GOTO 2985
+3400 GOTO 3430
+3405 GOTO 4585
+3410 GOTO 2115
+3415 GOTO 1495
+3420 GOTO 2780
+3425 GOTO 230
+3430 GOTO 375
+3435 GOTO 2515
+3440 GOTO 2600
+3445 GOTO 1645
+3450 GOTO 310
+3455 GOTO 3470
+3460 GOTO 4405
+3465 GOTO 2185
+3470 GOTO 3345
+3475 GOTO 1475
+3480 GOTO 3315
+3485 GOTO 3985
+3490 GOTO 4285
+3495 GOTO 2345
+3500 GOTO 2220
+3505 GOTO 630
+3510 GOTO 4395
+3515 GOTO 450
+3520 GOTO 4100
+3525 GOTO 2080
+3530 GOTO 4345
+3535 GOTO 4495
+3540 GOTO 2200
+3545 GOTO 265
+3550 GOTO 4070
+3555 GOTO 2120
+3560 GOTO 4410
+3565 GOTO 1280
+3570 GOTO 2690
+3575 GOTO 445
+3580 GOTO 1630
+3585 GOTO 3750
+3590 GOTO 2320
+3595 GOTO 3630
+3600 GOTO 2000
+3605 GOTO 2475
+3610 GOTO 2050
+3615 GOTO 2705
+3620 GOTO 3635
+3625 GOTO 2675
+3630 GOTO 720
+3635 GOTO 815
+3640 GOTO 2355
+3645 GOTO 4170
+3650 GOTO 1335
+3655 GOTO 3325
+3660 GOTO 110
+3665 GOTO 3795
+3670 GOTO 3335
+3675 GOTO 4825
+3680 GOTO 1315
+3685 GOTO 3080
+3690 GOTO 850
+3695 GOTO 2905
+3700 GOTO 1675
+3705 GOTO 4955
+3710 GOTO 2530
+3715 GOTO 1345
+3720 GOTO 3520
+3725 GOTO 335
+3730 GOTO 1095
+3735 GOTO 3075
+3740 GOTO 4945
+3745 GOTO 1990
+3750 GOTO 2815
+3755 GOTO 4315
+3760 GOTO 690
+3765 GOTO 1490
+3770 GOTO 3375
+3775 GOTO 1945
+3780 GOTO 280
+3785 GOTO 3735
+3790 GOTO 1460
+3795 GOTO 4650
+3800 GOTO 4145
+3805 GOTO 3320
+3810 GOTO 1900
+3815 GOTO 2260
+3820 GOTO 1350
+3825 GOTO 3950
+3830 GOTO 3215
+3835 GOTO 1395
+3840 GOTO 1540
+3845 GOTO 1230
+3850 GOTO 2605
+3855 GOTO 1880
+3860 GOTO 2325
+3865 GOTO 390
+3870 GOTO 2085
+3875 GOTO 3550
+3880 GOTO 3185
+3885 GOTO 3340
+3890 GOTO 4110
+3895 GOTO 5085
+3900 GOTO 715
+3905 GOTO 1340
+3910 GOTO 1910
+3915 GOTO 2410
+3920 GOTO 500
+3925 GOTO 1840
+3930 GOTO 195
+3935 GOTO 4295
+3940 GOTO 3275
+3945 GOTO 1685
+3950 GOTO 4030
+3955 GOTO 2875
+3960 GOTO 170
+3965 GOTO 3960
+3970 GOTO 2615
+3975 GOTO 710
+3980 GOTO 1155
+3985 GOTO 4245
+3990 GOTO 3800
+3995 GOTO 2635
+4000 GOTO 3210
+4005 GOTO 2795
+4010 GOTO 4205
+4015 GOTO 2900
+4020 GOTO 2745
+4025 GOTO 4000
+4030 GOTO 2285
+4035 GOTO 4865
+4040 GOTO 5000
+4045 GOTO 160
+4050 GOTO 2960
+4055 GOTO 4885
+4060 GOTO 4390
+4065 GOTO 2245
+4070 GOTO 3695
+4075 GOTO 2365
+4080 GOTO 2755
+4085 GOTO 650
+4090 GOTO 1955
+4095 GOTO 915
+4100 GOTO 3065
+4105 GOTO 4060
+4110 GOTO 2060
+4115 GOTO 4485
+4120 GOTO 3020
+4125 GOTO 3290
+4130 GOTO 440
+4135 GOTO 2040
+4140 GOTO 510
+4145 GOTO 4710
+4150 GOTO 4705
+4155 GOTO 2505
+4160 GOTO 3715
+4165 GOTO 4190
+4170 GOTO 215
+4175 GOTO 4020
+4180 GOTO 3905
+4185 GOTO 1525
+4190 GOTO 4055
+4195 GOTO 4065
+4200 GOTO 3920
+4205 GOTO 4435
+4210 GOTO 4105
+4215 GOTO 4725
+4220 GOTO 5010
+4225 GOTO 930
+4230 GOTO 1210
+4235 GOTO 1465
+4240 GOTO 2720
+4245 GOTO 2850
+4250 GOTO 3570
+4255 GOTO 605
+4260 GOTO 140
+4265 GOTO 1665
+4270 GOTO 3930
+4275 GOTO 535
+4280 GOTO 1500
+4285 GOTO 4935
+4290 GOTO 4520
+4295 GOTO 4755
+4300 GOTO 1895
+4305 GOTO 2810
+4310 GOTO 2940
+4315 GOTO 260
+4320 GOTO 3040
+4325 GOTO 1740
+4330 GOTO 1375
+4335 GOTO 2235
+4340 GOTO 3000
+4345 GOTO 2695
+4350 GOTO 1045
+4355 GOTO 3915
+4360 GOTO 4280
+4365 GOTO 4300
+4370 GOTO 3475
+4375 GOTO 4670
+4380 GOTO 2935
+4385 GOTO 2230
+4390 GOTO 3155
+4395 GOTO 5035
+4400 GOTO 2765
+4405 GOTO 4845
+4410 GOTO 4050
+4415 GOTO 4875
+4420 GOTO 2335
+4425 GOTO 4805
+4430 GOTO 2655
+4435 GOTO 3010
+4440 GOTO 3700
+4445 GOTO 1145
+4450 GOTO 4005
+4455 GOTO 1100
+4460 GOTO 3280
+4465 GOTO 3115
+4470 GOTO 3100
+4475 GOTO 4220
+4480 GOTO 795
+4485 GOTO 4340
+4490 GOTO 645
+4495 GOTO 3680
+4500 GOTO 3805
+4505 GOTO 2385
+4510 GOTO 1515
+4515 GOTO 2470
+4520 GOTO 1930
+4525 GOTO 3390
+4530 GOTO 3710
+4535 GOTO 465
+4540 GOTO 3110
+4545 GOTO 4855
+4550 GOTO 4640
+4555 GOTO 2425
+4560 GOTO 2860
+4565 GOTO 1680
+4570 GOTO 830
+4575 GOTO 5015
+4580 GOTO 1925
+4585 GOTO 3755
+4590 GOTO 950
+4595 GOTO 2350
+4600 GOTO 4275
+4605 GOTO 3515
+4610 GOTO 145
+4615 GOTO 3105
+4620 GOTO 150
+4625 GOTO 4400
+4630 GOTO 130
+4635 GOTO 1075
+4640 GOTO 4215
+4645 GOTO 4575
+4650 GOTO 685
+4655 GOTO 4425
+4660 GOTO 3260
+4665 GOTO 3645
+4670 GOTO 245
+4675 GOTO 3490
+4680 GOTO 3590
+4685 GOTO 1800
+4690 GOTO 345
+4695 GOTO 3415
+4700 GOTO 3330
+4705 GOTO 860
+4710 GOTO 1470
+4715 GOTO 620
+4720 GOTO 4840
+4725 GOTO 4990
+4730 GOTO 2495
+4735 GOTO 4655
+4740 GOTO 100
+4745 GOTO 1510
+4750 GOTO 1710
+4755 GOTO 1600
+4760 GOTO 3725
+4765 GOTO 3775
+4770 GOTO 910
+4775 GOTO 480
+4780 GOTO 4165
+4785 GOTO 1905
+4790 GOTO 3540
+4795 GOTO 1485
+4800 GOTO 900
+4805 GOTO 350
+4810 GOTO 2010
+4815 GOTO 2330
+4820 GOTO 3225
+4825 GOTO 3455
+4830 GOTO 2225
+4835 GOTO 2965
+4840 GOTO 3370
+4845 GOTO 4095
+4850 GOTO 165
+4855 GOTO 1570
+4860 GOTO 2660
+4865 GOTO 865
+4870 GOTO 1440
+4875 GOTO 1575
+4880 GOTO 820
+4885 GOTO 1560
+4890 GOTO 1035
+4895 GOTO 4590
+4900 GOTO 1555
+4905 GOTO 1580
+4910 GOTO 3420
+4915 GOTO 1160
+4920 GOTO 1325
+4925 GOTO 2025
+4930 GOTO 4985
+4935 GOTO 2895
+4940 GOTO 2835
+4945 GOTO 4685
+4950 GOTO 1190
+4955 GOTO 920
+4960 GOTO 4630
+4965 GOTO 2070
+4970 GOTO 945
+4975 GOTO 3760
+4980 GOTO 3395
+4985 GOTO 3035
+4990 GOTO 3505
+4995 GOTO 3510
+5000 GOTO 2590
+5005 GOTO 3815
+5010 GOTO 995
+5015 GOTO 2460
+5020 GOTO 2710
+5025 GOTO 1785
+5030 GOTO 590
+5035 GOTO 560
+5040 GOTO 3240
+5045 GOTO 1735
+5050 GOTO 1220
+5055 GOTO 2340
+5060 GOTO 4040
+5065 GOTO 2920
+5070 GOTO 2140
+5075 GOTO 1235
+5080 GOTO 3790
+5085 GOTO 3140
+5090 GOTO 3970
+5095 GOTO 2175
@@ -0,0 +1,14 @@
+10 REM Primes generator, get all primes up to max prime
+20 PRINT "Enter max prime: ":
+30 C = 2000
+40 A = 2
+50 GOTO 90
+60 A = A + 1
+70 IF A < C + 1 THEN GOTO 50
+80 END
+90 B = 2
+100 IF A % B = 0 THEN GOTO 60
+110 B = B + 1
+120 IF B < A / 2 THEN GOTO 100
+130 PRINT A
+140 GOTO 60
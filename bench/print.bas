@@ -0,0 +1,7 @@
+10 REM Number printing
+20 A = 1000000007
+30 C = 200
+40 PRINT A: " ": -A: " ": C
+50 A = A + 99991
+60 C = C - 1
+70 IF C > 0 THEN GOTO 40
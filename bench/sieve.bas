@@ -0,0 +1,13 @@
+10 REM Sieve of Eratosthenes in an array, count of the primes below 1000
+20 N = 1000
+30 DIM P(N)
+40 C = 0
+50 FOR I = 2 TO N - 1
+60 IF P(I) <> 0 THEN GOTO 120
+70 C = C + 1
+80 IF I * I > N - 1 THEN GOTO 120
+90 FOR J = I * I TO N - 1 STEP I
+100 P(J) = 1
+110 NEXT J
+120 NEXT I
+130 PRINT C
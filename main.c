@@ -10,68 +10,396 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include <string.h>
+#include <limits.h>
 #include <ctype.h>
+#include <time.h>
 
 /****************************************************************************/
-// Start of the config section
+// Start of the config section, every define can be overridden from tinybasic_config.h
+// (which also holds the target profiles) or the compiler command line
 
+#if defined(__has_include)
+#if __has_include("tinybasic_config.h")
+#include "tinybasic_config.h"
+#endif
+#endif
+
+#ifndef NEWLINE
 #define NEWLINE           '\n'
+#endif
+#ifndef BACKSPACE
 #define BACKSPACE         '\b'
+#endif
+#ifndef BACKSPACE_STR
 #define BACKSPACE_STR     "\b \b"
+#endif
+#ifndef CODE_MEMORY_SIZE
 #define CODE_MEMORY_SIZE  8192
+#endif
+#ifndef EXPR_MAX_TOKENS
 #define EXPR_MAX_TOKENS   64
+#endif
+#ifndef MAX_LINENUM
 #define MAX_LINENUM       10000
+#endif
+#ifndef POKE_PEEK
 #define POKE_PEEK         0
+#endif
+#ifndef FILE_IO
 #define FILE_IO           1
+#endif
+#ifndef IO_KILL
 #define IO_KILL           0
+#endif
+#ifndef IO_KILL_INTERVAL
+#define IO_KILL_INTERVAL  64
+#endif
+#ifndef OUTPUT_CRLF
 #define OUTPUT_CRLF       0
+#endif
+#ifndef SHORT_STRING
 #define SHORT_STRING      0
+#endif
+#ifndef LOOPBACK
 #define LOOPBACK          0
+#endif
+#ifndef LINE_INDEX
+#define LINE_INDEX        1
+#endif
+#ifndef GAP_BUFFER
+#define GAP_BUFFER        1
+#endif
+#ifndef EXPR_RPN
+#define EXPR_RPN          1
+#endif
+#ifndef EXPR_CACHE_SIZE
+#define EXPR_CACHE_SIZE   256
+#endif
+#ifndef EXPR_CACHE_POOL
+#define EXPR_CACHE_POOL   4096
+#endif
+#ifndef STMT_CACHE_SIZE
+#define STMT_CACHE_SIZE   256
+#endif
+#ifndef PROFILE
+#define PROFILE           0
+#endif
+#ifndef PROFILE_TOP
+#define PROFILE_TOP       10
+#endif
+#ifndef BATCH_MODE
+#define BATCH_MODE        1
+#endif
+#ifndef PRINT_FORMAT
+#define PRINT_FORMAT      1
+#endif
+#ifndef OUTPUT_BUFFER_SIZE
+#define OUTPUT_BUFFER_SIZE 256
+#endif
+#ifndef OUTPUT_IRQ
+#define OUTPUT_IRQ        0
+#endif
+#ifndef RUN_THREADED
+#define RUN_THREADED      1
+#endif
+#ifndef CONTROL_STACK_SIZE
+#define CONTROL_STACK_SIZE 16
+#endif
+#ifndef EXPR_CHECKED
+#define EXPR_CHECKED      0
+#endif
+#ifndef BATCH_THREADS
+#define BATCH_THREADS     4
+#endif
+#ifndef ARRAYS
+#define ARRAYS            1
+#endif
+#ifndef STEP_API
+#define STEP_API          0
+#endif
+#ifndef STEP_SLICE
+#define STEP_SLICE        32
+#endif
+#ifndef RUN_LIMITS
+#define RUN_LIMITS        1
+#endif
+#ifndef RUN_ANALYZER
+#define RUN_ANALYZER      1
+#endif
+#ifndef INPUT_BUFFER_SIZE
+#define INPUT_BUFFER_SIZE 4096
+#endif
+#ifndef STMT_FUSION
+#define STMT_FUSION       1
+#endif
+#ifndef STATS
+#define STATS             1
+#endif
 
-typedef uint16_t          line_t;
-typedef int32_t           var_t;
-typedef uint32_t          uvar_t;
-typedef size_t            peek_t;
+#ifndef LINE_T
+#define LINE_T            uint16_t
+#endif
+#ifndef VAR_T
+#define VAR_T             int32_t
+#endif
+#ifndef UVAR_T
+#define UVAR_T            uint32_t
+#endif
+#ifndef PEEK_T
+#define PEEK_T            size_t
+#endif
 
+typedef LINE_T            line_t;
+typedef VAR_T             var_t;
+typedef UVAR_T            uvar_t;
+typedef PEEK_T            peek_t;
+
+#ifndef IO_INIT
 #define IO_INIT()         ((void)0)
+#endif
+#ifndef PUTCHAR
 #define PUTCHAR(x)        (putchar(*x))
+#endif
+#ifndef GETCHAR
 #define GETCHAR(x)        (*x = getchar())
+#endif
+#ifndef IO_CHECK
 #define IO_CHECK(x)       (*x = false)
+#endif
+#ifndef FLUSH
+#define FLUSH(x, n)       { fwrite(x, 1, n, stdout); fflush(stdout); }
+#endif
+#ifndef READ
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#define READ(x, n)        (read_stdin(x, n))
+#define READ_STDIN        1
+#else
+#define READ(x, n)        ((fgets(x, n, stdin)) ? strlen(x) : 0)
+#endif
+#endif
+#ifndef PROFILE_TICKS
+#define PROFILE_TICKS()   ((unsigned long)clock())
+#endif
+#ifndef IDLE
+#define IDLE()            ((void)0)
+#endif
+#ifndef RUN_CLOCK
+#ifdef CLOCK_MONOTONIC
+#define RUN_CLOCK()       (io_default_clock())
+#else
+#define RUN_CLOCK()       ((unsigned long)(clock() * 1000.0 / CLOCKS_PER_SEC))
+#endif
+#endif
 
 // End of the config section
 /****************************************************************************/
 
 #define LIST_DEBUG        0
 #define EXPR_DEBUG        0
+#ifndef BENCH
+#define BENCH             0
+#endif
+#ifndef FUZZ
+#define FUZZ              0
+#endif
+
+#if BENCH == 1
+// Benchmark build, output is only counted and programs are given on the command line
+#undef CODE_MEMORY_SIZE
+#define CODE_MEMORY_SIZE  65536
+#undef OUTPUT_IRQ
+#define OUTPUT_IRQ        0
+#undef FILE_IO
+#define FILE_IO           1
+#define BENCH_TIME        (CLOCKS_PER_SEC / 2)
+#define BENCH_COUNT(x)    (tb->bench_##x++)
+#else
+#define BENCH_COUNT(x)    ((void)0)
+#endif
+
+#if FUZZ == 1
+// Differential fuzz build, the generated programs are run with the output hashed
+#if BENCH == 1
+#error "FUZZ and BENCH builds have their own main()"
+#endif
+#undef CODE_MEMORY_SIZE
+#define CODE_MEMORY_SIZE  65536
+#undef OUTPUT_IRQ
+#define OUTPUT_IRQ        0
+#define FUZZ_TIME         (CLOCKS_PER_SEC / 1000)
+#define FUZZ_ROUNDS       5
+#define FUZZ_TEXT_SIZE    8192
+#define FUZZ_SLOWDOWN     10
+#define FUZZ_CASE_SLOWDOWN 50
+#define FUZZ_RETIMES      3
+#define FUZZ_SLOW_CASES   5
+#endif
+
+#if STATS == 1
+#define STATS_ADD(x, n)   (tb->stats[x] += (n))
+#else
+#define STATS_ADD(x, n)   ((void)0)
+#endif
 
 /****************************************************************************/
 
-// Command constants
-const char *kwd_clear  = "CLEAR";
-const char *kwd_end    = "END";
-const char *kwd_goto   = "GOTO";
-const char *kwd_if     = "IF";
-const char *kwd_input  = "INPUT";
-const char *kwd_let    = "LET";
-const char *kwd_list   = "LIST";
-const char *kwd_memory = "MEMORY";
-const char *kwd_new    = "NEW";
-const char *kwd_print  = "PRINT";
-const char *kwd_char   = "CHAR";
-const char *kwd_rem    = "REM";
-const char *kwd_run    = "RUN";
-const char *kwd_then   = "THEN";
+// Keyword tokens, stored in codemem in place of the keyword text
+enum EKeywordTokens {
+  TK_CLEAR = 0x80,
+  TK_END,
+  TK_GOTO,
+  TK_IF,
+  TK_INPUT,
+  TK_LET,
+  TK_LIST,
+  TK_MEMORY,
+  TK_NEW,
+  TK_PRINT,
+  TK_CHAR,
+  TK_REM,
+  TK_RUN,
+  TK_THEN,
+  TK_PEEK,
+  TK_POKE,
+  TK_PEEKB,
+  TK_POKEB,
+  TK_LOAD,
+  TK_SAVE,
+  TK_PROFILE,
+  TK_HEX,
+  TK_BIN,
+  TK_BSAVE,
+  TK_FOR,
+  TK_TO,
+  TK_STEP,
+  TK_NEXT,
+  TK_GOSUB,
+  TK_RETURN,
+  TK_DIM,
+  TK_STATS,
+  TK_KEYWORDS_END,
+  TK_NUMBER_DEC = 0xBB,   // Number literals, followed by the value in digit bytes
+  TK_NUMBER_HEX,
+  TK_NUMBER_HEX_LOWER,
+  TK_NUMBER_OCT,
+  TK_NUMBER_BIN,
+  TK_NUMBER_DIGIT = 0xC0  // Digit bytes have the 2 top bits set and carry 6 bits each
+};
+
+// Command constants (in the keyword token order, NULL if disabled)
+#define KEYWORD_COUNT (TK_KEYWORDS_END - TK_CLEAR)
+const char *keywords[KEYWORD_COUNT] = {
+  "CLEAR",
+  "END",
+  "GOTO",
+  "IF",
+  "INPUT",
+  "LET",
+  "LIST",
+  "MEMORY",
+  "NEW",
+  "PRINT",
+  "CHAR",
+  "REM",
+  "RUN",
+  "THEN",
 #if POKE_PEEK == 1
-const char *kwd_peek   = "PEEK";
-const char *kwd_poke   = "POKE";
-const char *kwd_peekb  = "PEEKB";
-const char *kwd_pokeb  = "POKEB";
+  "PEEK",
+  "POKE",
+  "PEEKB",
+  "POKEB",
+#else
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+#endif
+#if FILE_IO == 1
+  "LOAD",
+  "SAVE",
+#else
+  NULL,
+  NULL,
+#endif
+#if PROFILE == 1
+  "PROFILE",
+#else
+  NULL,
+#endif
+#if PRINT_FORMAT == 1
+  "HEX",
+  "BIN",
+#else
+  NULL,
+  NULL,
 #endif
 #if FILE_IO == 1
-const char *kwd_load   = "LOAD";
-const char *kwd_save   = "SAVE";
+  "BSAVE",
+#else
+  NULL,
+#endif
+#if CONTROL_STACK_SIZE > 0
+  "FOR",
+  "TO",
+  "STEP",
+  "NEXT",
+  "GOSUB",
+  "RETURN",
+#else
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+#endif
+#if ARRAYS == 1
+  "DIM",
+#else
+  NULL,
+#endif
+#if STATS == 1
+  "STATS",
+#else
+  NULL,
+#endif
+};
+
+#if STATS == 1
+// Runtime counters, kept from the start of the interpreter
+enum EStats {
+  ST_STATEMENTS,    // Program statements executed
+  ST_EXPRS,         // Expressions solved
+  ST_EXPR_TOKENS,   // Tokens gone through by the evaluation (every reduction pass of the original solver)
+  ST_EXPR_COMPILES, // Expressions tokenized (not taken from the cache)
+  ST_STMT_DECODES,  // Statements decoded (not taken from the cache)
+  ST_FUSED,         // Fused operands and jumps taken without solving
+  ST_LINE_LOOKUPS,  // Line number searches
+  ST_LINE_SCANNED,  // Code bytes walked by the searches without the line index
+  ST_SHIFTED,       // Code bytes moved by the line edits
+  ST_COUNT
+};
+
+// Counter names for 'STATS' and the batch mode JSON
+const char *stats_names[ST_COUNT] = {
+  "statements",
+  "exprs",
+  "expr_tokens",
+  "expr_compiles",
+  "stmt_decodes",
+  "fused",
+  "line_lookups",
+  "line_scanned",
+  "shifted"
+};
 #endif
 
+// Keyword tokens grouped by their first letter, built on the first lookup
+static uint8_t keyword_order[KEYWORD_COUNT];
+static uint8_t keyword_first[27]; // Start of every letter group in keyword_order
+static bool keyword_table_valid;
+
 // Printable strings
 #if OUTPUT_CRLF == 1
 const char *str_lf                  = "\n\r";
@@ -93,6 +421,9 @@ const char *str_err_at_line1        = "E ";
 const char *str_err_at_line2        = ": ";
 const char *str_err_linenum         = "Linenum";
 const char *str_err_expression      = "Expression";
+const char *str_err_expr_long       = "Expr too long";
+const char *str_err_divide_zero     = "Div by 0";
+const char *str_err_overflow        = "Overflow";
 const char *str_err_run_mode        = "Not in RUN";
 const char *str_err_unknown         = "What?";
 const char *str_err_string          = "Str";
@@ -109,6 +440,18 @@ const char *str_err_input_target    = "What?";
 const char *str_err_poke_exprs      = "What?";
 const char *str_err_peek_exprs      = "What?";
 const char *str_err_peek_target     = "What?";
+const char *str_err_run_only        = "Only in RUN";
+const char *str_err_for_target      = "What?";
+const char *str_err_for_to          = "What?";
+const char *str_err_next_no_for     = "NEXT w/o FOR";
+const char *str_err_return_no_gosub = "RETURN w/o GOSUB";
+const char *str_err_control_full    = "Too deep";
+const char *str_err_line_limit      = "Line limit";
+const char *str_err_time_limit      = "Time limit";
+const char *str_err_dim_target      = "What?";
+const char *str_err_dim_twice       = "DIM twice";
+const char *str_err_array_dim       = "No array";
+const char *str_err_array_index     = "Index";
 const char *str_err_save_no_code    = "No code";
 const char *str_err_save_file       = "File failed";
 const char *str_err_load_file       = "File failed";
@@ -130,6 +473,9 @@ const char *str_err_at_line1        = "Error at line ";
 const char *str_err_at_line2        = ": ";
 const char *str_err_linenum         = "Invalid line number";
 const char *str_err_expression      = "Failed to evaluate expression";
+const char *str_err_expr_long       = "Expression too long";
+const char *str_err_divide_zero     = "Division by zero";
+const char *str_err_overflow        = "Arithmetic overflow";
 const char *str_err_run_mode        = "Command unavailable during run mode";
 const char *str_err_unknown         = "Unknown command";
 const char *str_err_string          = "Unclosed string";
@@ -146,9 +492,21 @@ const char *str_err_input_target    = "Expected target variable";
 const char *str_err_poke_exprs      = "Expected 2 expressions";
 const char *str_err_peek_exprs      = "Expected 2 expressions";
 const char *str_err_peek_target     = "Expected target variable";
+const char *str_err_run_only        = "Command only available during run mode";
+const char *str_err_for_target      = "Invalid loop variable";
+const char *str_err_for_to          = "Expected 'TO' token after the initial value";
+const char *str_err_next_no_for     = "'NEXT' without matching 'FOR'";
+const char *str_err_return_no_gosub = "'RETURN' without 'GOSUB'";
+const char *str_err_control_full    = "Too many nested loops and subroutines";
+const char *str_err_line_limit      = "Run took too many lines";
+const char *str_err_time_limit      = "Run took too long";
+const char *str_err_dim_target      = "Expected array variable followed by its size in brackets";
+const char *str_err_dim_twice       = "Array already dimensioned";
+const char *str_err_array_dim       = "Array not dimensioned";
+const char *str_err_array_index     = "Array index out of range";
 const char *str_err_save_no_code    = "No code to be saved";
 const char *str_err_save_file       = "Failed to open file";
-const char *str_err_load_file       = "Failed to open file";
+const char *str_err_load_file       = "Failed to load file";
 const char *str_err_run_no_code     = "No code to run, go write some";
 const char *str_err_line_not_found1 = "Line ";
 const char *str_err_line_not_found2 = " not found.";
@@ -172,6 +530,13 @@ enum EExprTokens {
   ET_INVERT,
   ET_SUBEXPR_OPEN,
   ET_SUBEXPR_CLOSE,
+  ET_VARIABLE,
+  ET_NEGATE,
+  ET_SHIFT_LEFT,
+  ET_SHIFT_RIGHT,
+  ET_MASK,
+  ET_ARRAY_OPEN,    // Bracket after the array variable (the letter is in the value)
+  ET_ARRAY,         // Array element of the index on the stack
   ET_SUBEXPR = 4
 };
 
@@ -183,161 +548,1028 @@ enum ECompareOperations {
   CO_LOWER
 };
 
-// Expression tokens
-typedef struct ExprToken ExprToken;
-struct ExprToken {
-  uint8_t type;
-  uint8_t precedence;
-  var_t value;
+// Detokenizer states
+enum EDetokenizeStates {
+  DS_CODE,
+  DS_STRING,
+  DS_VERBATIM
+};
+
+// Print statement part kinds (decoded statement commands other than keyword tokens)
+enum EPrintParts {
+  PP_NONE = 1,
+  PP_STRING,
+  PP_EXPRESSION
+};
+
+// Print statement part endings
+enum EPrintEndings {
+  PE_CONTINUE,
+  PE_LINEFEED,
+  PE_NO_LINEFEED,
+  PE_GARBAGE
+};
+
+// Fused statement operands, taken without solving their expressions
+enum EFusedOperands {
+  FO_EXPRESSION,  // Solved as usual
+  FO_VARIABLE,    // Value of the variable
+  FO_CONSTANT,    // The number itself
+  FO_INCREMENT    // Target variable of 'LET' with the number added
+};
+
+// Decoded statement, everything needed to execute it without parsing
+typedef struct Statement Statement;
+struct Statement {
+  size_t index;           // Index of the statement in codemem
+  uint8_t command;        // Command token or print part, 0 if not decoded
+  uint8_t variable;       // Target variable or the print number format token
+  uint8_t compare;        // Compare operation or print part ending
+  size_t expr_index[3];   // Expressions (string for the print part, loop start, limit and step)
+  size_t expr_length[3];
+  size_t next;            // Command after 'THEN' or the next print part
+  line_t target;          // Target line of 'GOTO' and 'GOSUB'
+  #if STMT_FUSION == 1
+  uint8_t operand[2];     // How the first two expressions are taken (FO_*)
+  var_t value[2];         // Their number or variable
+  size_t jump;            // Line of the fused 'IF ... THEN GOTO' (slot with LINE_INDEX, index otherwise)
+  #endif
+};
+#define NO_JUMP ((size_t)-1)
+
+// Buffer size for the number literal text (binary digits, prefix and the terminator)
+#define NUMBER_BUFFER_SIZE (sizeof(uvar_t) * 8 + 3)
+
+// Binary image header: magic, version, line_t size, keyword count, memory size and code length
+#define IMAGE_MAGIC       "TBIM"
+#define IMAGE_VERSION     1
+#define IMAGE_HEADER_SIZE 15
+
+// Expression tokens, kept in separate arrays so none of the space goes to the padding
+typedef struct ExprTokens ExprTokens;
+struct ExprTokens {
+  var_t value[EXPR_MAX_TOKENS];
+  uint8_t type[EXPR_MAX_TOKENS];
+  #if EXPR_RPN == 0
+  uint8_t precedence[EXPR_MAX_TOKENS];
+  #endif
 };
 
+// Limits of the variable values
+#define VAR_MAX           ((var_t)((uvar_t)-1 >> 1))
+#define VAR_MIN           (-VAR_MAX - 1)
+
 /****************************************************************************/
 
-// Token space for the expression solver
-static ExprToken expr_tokens[EXPR_MAX_TOKENS];
-static size_t expr_token_count;
+#if EXPR_RPN == 1 && EXPR_CACHE_SIZE > 0
+// Compiled expressions cache, programs are kept in the pool until it's full
+typedef struct ExprCache ExprCache;
+struct ExprCache {
+  size_t index;     // Index of the expression in codemem
+  size_t length;    // Length of the expression, 0 if entry is unused
+  size_t start;     // First token of the program in the pool
+  size_t count;
+};
+#endif
+
+#if PROFILE == 1 && LINE_INDEX == 0
+#error "PROFILE needs the LINE_INDEX to store the line statistics"
+#endif
+
+#if BATCH_MODE == 1 && FILE_IO == 0
+#error "BATCH_MODE needs the FILE_IO to load the program"
+#endif
+
+#if BATCH_THREADS > 0 && BATCH_MODE == 0
+#error "BATCH_THREADS needs the BATCH_MODE to run the programs"
+#endif
+
+#if ARRAYS == 1 && EXPR_RPN == 0
+#error "ARRAYS needs the EXPR_RPN to index the arrays in expressions"
+#endif
+
+#if ARRAYS == 1
+// Set in the statement variable when the target is an array element
+#define VARIABLE_ARRAY    0x80
+#endif
+
+#if RUN_THREADED == 1 && defined(__GNUC__)
+// GCC can jump straight to the statement labels, a switch is used elsewhere
+#define RUN_COMPUTED_GOTO 1
+#define RUN_LABEL(x)      x:
+#else
+#define RUN_COMPUTED_GOTO 0
+#define RUN_LABEL(x)
+#endif
+
+#if OUTPUT_BUFFER_SIZE > 0
+#if OUTPUT_IRQ == 1 && (OUTPUT_BUFFER_SIZE & (OUTPUT_BUFFER_SIZE - 1)) != 0
+#error "OUTPUT_BUFFER_SIZE has to be a power of 2 for the OUTPUT_IRQ"
+#endif
+#if OUTPUT_BUFFER_SIZE < 256
+typedef uint8_t outbuf_t;
+#else
+typedef size_t outbuf_t;
+#endif
+
+#define OUTPUT(x)         (output_char(tb, *(x)))
+#define INPUT_CHAR(x)     { output_flush(tb); *(x) = tb->io.get(tb->io.user); }
+#else
+#define OUTPUT(x)         (tb->io.put(tb->io.user, *(x)))
+#define INPUT_CHAR(x)     (*(x) = tb->io.get(tb->io.user))
+#endif
+
+#if INPUT_BUFFER_SIZE > 0
+#if INPUT_BUFFER_SIZE < 2
+#error "INPUT_BUFFER_SIZE has to leave space for a character and the terminator"
+#endif
+// Characters are taken from the input buffer, it's filled in blocks by the read callback
+#undef INPUT_CHAR
+#define INPUT_CHAR(x)     (*(x) = input_char(tb))
+#endif
+
+#if LINE_INDEX == 1
+// Line number lookup table, sorted by the line number (every line takes at least 2 bytes)
+#define LINE_INDEX_SIZE   (CODE_MEMORY_SIZE / (sizeof(line_t) + 2))
+typedef struct LineIndex LineIndex;
+struct LineIndex {
+  line_t linenum;
+  size_t index;     // Index of the line number in codemem
+  size_t jump;      // Slot of the line 'GOTO' jumps to (resolved by RUN)
+  #if PROFILE == 1
+  unsigned long hits;
+  unsigned long ticks;
+  #endif
+};
+#endif
+
+#if CONTROL_STACK_SIZE > 0
+// Control stack of the running 'FOR' loops and 'GOSUB' calls
+#define CF_GOSUB          0xFF
+#define CF_ANY            0xFE
+typedef struct ControlFrame ControlFrame;
+struct ControlFrame {
+  size_t position;  // Line index slot (or an index in the line without LINE_INDEX) to continue after
+  uint8_t variable; // Loop variable or CF_GOSUB
+  var_t limit;
+  var_t step;
+};
+
+// Position of the running line kept in the control frames
+#if LINE_INDEX == 1
+#define RUN_POSITION(index, slot) (slot)
+#else
+#define RUN_POSITION(index, slot) (index)
+#endif
+#endif
+
+#if RUN_LIMITS == 1
+// Lines run between the time limit checks
+#define LIMIT_SLICE       1024
+#endif
+
+#if STEP_API == 1
+// What the interpreter driven by tb_step() and tb_feed_char() is doing
+#define STEP_SHELL        0 // Reading the shell line
+#define STEP_LINE         1 // The shell line is complete and waits to be executed
+#define STEP_CONFIRM      2 // 'NEW' waits for the confirmation
+#define STEP_RUN          3 // The program is running
+#define STEP_INPUT        4 // The program waits for the 'INPUT' value
+#define STEP_INPUT_DONE   5 // The 'INPUT' value is complete and waits for the program
+#endif
+
+// IO callbacks of an interpreter, user is passed back to each of them
+typedef struct InterpreterIO InterpreterIO;
+struct InterpreterIO {
+  void (*put)(void *user, char chr);
+  char (*get)(void *user);
+  bool (*check)(void *user);  // Return true if new characters were received (IO_KILL)
+  void (*flush)(void *user, const char *buffer, size_t length);
+  size_t (*read)(void *user, char *buffer, size_t size); // Read a block of the input, 0 at its end (INPUT_BUFFER_SIZE)
+  void *user;
+};
+
+// Interpreter state, every function working on the program gets it as the first argument
+typedef struct Interpreter Interpreter;
+struct Interpreter {
+  InterpreterIO io;
+
+  // Code memory
+  char codemem[CODE_MEMORY_SIZE];
+  size_t codemem_end; // The byte after the last saved line
+  size_t newline_ind; // The first byte of the new line
+  size_t newline_end; // The byte after the new line
+  #if GAP_BUFFER == 1
+  size_t gap_end;     // The first byte of the lines kept after the gap
+  #endif
+
+  // Variables for each letter of the alphabet
+  var_t variables[26];
+
+  // Current line for when the code is executing
+  line_t current_line;
+
+  // Set when any error gets reported, used for the batch mode exit code
+  bool error_reported;
+
+  #if IO_KILL == 1
+  // Set by interpreter_break() to stop the program before its next line
+  volatile bool break_request;
+  #if IO_KILL_INTERVAL > 0
+  unsigned int kill_countdown; // Lines left until the received characters are checked
+  #endif
+  #endif
+
+  // Position of the running program, kept when run_slice() stops in the middle
+  size_t run_index;
+  #if LINE_INDEX == 1
+  size_t run_slot;
+  #endif
+
+  #if RUN_LIMITS == 1
+  // Limits of every run set by interpreter_limit(), 0 is no limit
+  unsigned long line_limit;
+  unsigned long time_limit; // Milliseconds of RUN_CLOCK(), checked between the slices
+  unsigned long run_lines;  // Lines left to the running program
+  unsigned long run_clock;  // RUN_CLOCK() when the program started
+  #endif
+
+  #if STEP_API == 1
+  // State of the step driven interpreter
+  uint8_t step_state;
+  size_t input_length; // Characters of the 'INPUT' value received so far
+  line_t input_linenum; // Line waiting for the 'INPUT' value, run_index can be in its middle
+  #endif
+
+  // Token space for the expression solver
+  ExprTokens expr_tokens;
+  size_t expr_token_count;
+
+  #if EXPR_RPN == 1 && EXPR_CACHE_SIZE > 0
+  // Compiled expressions cache and the pool of their tokens
+  ExprCache expr_cache[EXPR_CACHE_SIZE];
+  var_t expr_cache_value[EXPR_CACHE_POOL];
+  uint8_t expr_cache_type[EXPR_CACHE_POOL];
+  size_t expr_cache_pool_end;
+  bool expr_cache_valid;
+  #endif
+
+  #if STMT_CACHE_SIZE > 0
+  // Decoded statements cache, indexed by the statement index in codemem
+  Statement stmt_cache[STMT_CACHE_SIZE];
+  bool stmt_cache_valid;
+  #endif
+
+  #if RUN_ANALYZER == 1
+  // Set when every line passed analyze_program(), until the code changes
+  bool program_checked;
+  #endif
+
+  #if LINE_INDEX == 1
+  // Line number lookup table
+  LineIndex line_index[LINE_INDEX_SIZE];
+  size_t line_count;
+  #endif
+
+  #if CONTROL_STACK_SIZE > 0
+  // Running 'FOR' loops and 'GOSUB' calls
+  ControlFrame control_stack[CONTROL_STACK_SIZE];
+  size_t control_depth;
+  ControlFrame *control_resume; // Frame to continue after, set with MAX_LINENUM returned
+  #endif
+
+  #if ARRAYS == 1
+  // Arrays, allocated downwards from the end of the code memory until the code changes
+  size_t array_start[26];   // Index of the first element in codemem
+  size_t array_length[26];  // Number of elements, 0 if not dimensioned
+  size_t arena_start;       // The first byte taken by the arrays
+  #endif
+
+  #if INPUT_BUFFER_SIZE > 0
+  // Input buffer, filled by the read callback
+  char input_buffer[INPUT_BUFFER_SIZE];
+  size_t input_head;  // Next byte to be taken
+  size_t input_tail;  // The byte after the last one read
+  #endif
+
+  #if OUTPUT_BUFFER_SIZE > 0
+  // Output buffer, drained by the flush callback in blocks or by the TX interrupt (OUTPUT_IRQ)
+  char output_buffer[OUTPUT_BUFFER_SIZE];
+  volatile outbuf_t output_head; // Next byte to be written
+  volatile outbuf_t output_tail; // Next byte to be sent (OUTPUT_IRQ only)
+  #endif
+
+  #if STATS == 1
+  unsigned long stats[ST_COUNT]; // Runtime counters (ST_*)
+  #endif
+
+  #if BENCH == 1
+  // Benchmark counters
+  unsigned long bench_lines;
+  unsigned long bench_exprs;
+  unsigned long bench_jumps;
+  unsigned long bench_errors;
+  unsigned long bench_output;
+  #endif
+
+  #if FUZZ == 1
+  uint32_t fuzz_hash; // Hash of the output
+  #endif
+};
+
+#if OUTPUT_IRQ == 1
+// Interpreter owning the TX interrupt
+static Interpreter *output_owner;
+#endif
+
+#if BATCH_THREADS > 0
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+// Batch runner job, a program with the file its 'INPUT' reads from
+typedef struct BatchJob BatchJob;
+struct BatchJob {
+  const char *program;
+  const char *input;        // NULL answers every 'INPUT' with an empty line
+  bool owned;               // The program name was allocated for a directory entry
+};
+
+// Growable list of the batch jobs
+typedef struct BatchList BatchList;
+struct BatchList {
+  BatchJob *jobs;
+  size_t count;
+  size_t size;
+};
+
+// Batch runner worker, owns an interpreter and the output of its current job
+typedef struct BatchRunner BatchRunner;
+typedef struct BatchWorker BatchWorker;
+struct BatchWorker {
+  BatchRunner *runner;
+  pthread_t thread;
+  pthread_mutex_t lock;     // Guards the job range, other workers steal from its end
+  size_t next;              // Range of the jobs left to this worker
+  size_t end;
+  Interpreter *tb;
+  FILE *input;
+  char *output;
+  size_t output_length;
+  size_t output_size;
+};
 
-// Variables for each letter of the alphabet
-static var_t variables[26];
+// Batch runner state shared by the workers
+struct BatchRunner {
+  const BatchJob *jobs;
+  BatchWorker *workers;
+  size_t worker_count;
+  pthread_mutex_t print_lock; // Keeps the job results in one piece
+  int result;                 // Highest exit code of the jobs
+  unsigned long line_limit;   // Limits of every job run (RUN_LIMITS)
+  unsigned long time_limit;
+  #if STATS == 1
+  unsigned long stats[ST_COUNT]; // Runtime counters of all the jobs
+  #endif
+};
+#endif
 
-// Code memory
-static char codemem[CODE_MEMORY_SIZE];
-static size_t codemem_end; // The byte after the last saved line
-static size_t newline_ind; // The first byte of the new line
-static size_t newline_end; // The byte after the new line
+#if FUZZ == 1
+// Generated program of a fuzz case
+typedef struct FuzzProgram FuzzProgram;
+struct FuzzProgram {
+  uint32_t state;             // Random generator state, seeded by the case
+  char text[FUZZ_TEXT_SIZE];  // Program lines, each one ends with a line feed
+  size_t length;
+};
 
-// Current line for when the code is executing
-static line_t current_line;
+// What the case did and how long it took
+typedef struct FuzzResult FuzzResult;
+struct FuzzResult {
+  uint32_t output;    // Hash of the output of the first run
+  uint32_t variables; // Hash of the variables after it
+  double ns;          // Time of a single run
+};
+#endif
 
 /****************************************************************************/
 
+// Interpreter setup
+void io_default_put(void *user, char chr);
+char io_default_get(void *user);
+bool io_default_check(void *user);
+void io_default_flush(void *user, const char *buffer, size_t length);
+#if defined(READ_STDIN) && INPUT_BUFFER_SIZE > 0
+size_t read_stdin(char *buffer, size_t size);
+#endif
+size_t io_default_read(void *user, char *buffer, size_t size);
+void interpreter_init(Interpreter *tb, const InterpreterIO *io);
+#if IO_KILL == 1
+void interpreter_break(Interpreter *tb);
+#endif
+#if RUN_LIMITS == 1
+#ifdef CLOCK_MONOTONIC
+unsigned long io_default_clock(void);
+#endif
+void interpreter_limit(Interpreter *tb, unsigned long lines, unsigned long ms);
+#endif
+
+// Input buffer
+#if INPUT_BUFFER_SIZE > 0
+bool input_fill(Interpreter *tb);
+char input_char(Interpreter *tb);
+bool input_line(Interpreter *tb, const char **line, size_t *length, bool *complete);
+void input_copy(Interpreter *tb, const char *line, size_t length, bool complete, size_t start, size_t *end);
+bool input_number(const char *line, size_t length, var_t *value);
+#endif
+
 // Printing utilities
-void print_string(const char *string);
-void print_unsigned(uvar_t value);
-void print_signed(var_t value);
+#if OUTPUT_BUFFER_SIZE > 0
+void output_char(Interpreter *tb, char chr);
+void output_flush(Interpreter *tb);
+#if OUTPUT_IRQ == 1
+bool output_next(char *chr);
+#endif
+#endif
+void print_string(Interpreter *tb, const char *string);
+void print_unsigned(Interpreter *tb, uvar_t value);
+void print_signed(Interpreter *tb, var_t value);
 
 // Command handling utilities
-static inline void skip_spaces(size_t *index);
-var_t get_literal_number(size_t index, bool *error);
+static inline void skip_spaces(Interpreter *tb, size_t *index);
+var_t get_literal_number(Interpreter *tb, size_t index, bool *error);
+static inline bool is_number_token(char chr);
+var_t get_number(Interpreter *tb, size_t *index, bool *error);
+
+// Code tokenizing
+void keyword_table_build(void);
+uint8_t keyword_lookup(Interpreter *tb, size_t index, size_t length);
+size_t tokenize_number(Interpreter *tb, size_t index, size_t length, size_t out);
+size_t tokenize_line(Interpreter *tb, size_t index, size_t end);
+size_t format_number(uvar_t value, uint8_t token, char *buffer);
+size_t detokenize(Interpreter *tb, size_t index, char *buffer, uint8_t *state);
+void print_code(Interpreter *tb, size_t index);
 
 // Code memory handling
-static inline line_t load_line_t(size_t index);
-static inline void store_line_t(size_t index, line_t linenum);
-line_t get_line_num(size_t index);
-size_t get_line_index(line_t linenum);
-size_t get_line_next_index(line_t linenum);
-static inline void codemem_shift_left(size_t index, size_t length, size_t amount);
-static inline void codemem_shift_right(size_t index, size_t length, size_t amount);
+static inline line_t load_line_t(Interpreter *tb, size_t index);
+static inline void store_line_t(Interpreter *tb, size_t index, line_t linenum);
+line_t get_line_num(Interpreter *tb, size_t index);
+size_t get_line_index(Interpreter *tb, line_t linenum);
+size_t get_potential_line_index(Interpreter *tb, line_t linenum);
+#if LINE_INDEX == 1
+size_t line_index_find(Interpreter *tb, line_t linenum);
+void line_index_insert(Interpreter *tb, size_t slot, line_t linenum, size_t index, size_t shift);
+void line_index_remove(Interpreter *tb, size_t slot, size_t shift);
+#endif
+static inline void codemem_shift_left(Interpreter *tb, size_t index, size_t length, size_t amount);
+static inline void codemem_shift_right(Interpreter *tb, size_t index, size_t length, size_t amount);
+static inline size_t codemem_free_end(Interpreter *tb);
+#if GAP_BUFFER == 1
+void codemem_reverse(Interpreter *tb, size_t index, size_t length);
+void codemem_rotate(Interpreter *tb, size_t index, size_t first, size_t second);
+void gap_move(Interpreter *tb, size_t target, size_t length);
+void gap_close(Interpreter *tb);
+size_t gap_find_line(Interpreter *tb, line_t linenum, bool *found);
+#endif
 void insert_line(size_t ind);
-void store_newline(size_t ind);
+static void code_changed(Interpreter *tb);
+void store_newline(Interpreter *tb, size_t ind);
 
 // Expression solving
-var_t expr_solve(size_t index, size_t length, bool *error);
-void expr_tokenize(size_t index, size_t length);
-bool expr_calc_precedence(void);
-void expr_filter_brackets(void);
-bool expr_reduce(void);
-bool expr_reduce_unary(void);
-bool expr_reduce_check(size_t index);
-void expr_erase(size_t index, size_t length);
+var_t expr_solve(Interpreter *tb, size_t index, size_t length, bool *error);
+const char *expr_tokenize(Interpreter *tb, size_t index, size_t length);
+bool expr_check(Interpreter *tb, size_t index, size_t length);
+static inline const char *expr_divide(uint8_t type, var_t *left, var_t right);
+#if EXPR_CHECKED == 1
+static inline bool expr_overflow(uint8_t type, var_t left, var_t right, var_t *result);
+#endif
+#if EXPR_RPN == 1
+static inline uint8_t expr_precedence(uint8_t type);
+bool expr_compile(Interpreter *tb);
+var_t expr_evaluate(Interpreter *tb, const uint8_t *types, const var_t *values, size_t count, size_t index, bool *error);
+#if EXPR_CACHE_SIZE > 0
+ExprCache *expr_cache_find(Interpreter *tb, size_t index, size_t length);
+void expr_cache_store(Interpreter *tb, ExprCache *cache, size_t index, size_t length);
+void expr_cache_clear(Interpreter *tb);
+#endif
+#else
+bool expr_calc_precedence(Interpreter *tb);
+void expr_filter_brackets(Interpreter *tb);
+const char *expr_reduce(Interpreter *tb);
+bool expr_reduce_unary(Interpreter *tb);
+bool expr_reduce_check(Interpreter *tb, size_t index);
+void expr_erase(Interpreter *tb, size_t index, size_t length);
+#endif
 
 // Command execution utilities
-bool command_compare(const char *command, size_t index);
-line_t print_error(const char *error, size_t index);
-line_t execute_command(size_t index);
-line_t handle_let(size_t index);
-line_t handle_print(size_t index);
-line_t handle_char(size_t index);
-line_t handle_if(size_t index);
-line_t handle_goto(size_t index);
-line_t handle_input(size_t index);
-void handle_list(void);
-void handle_new(void);
-void handle_run(void);
+bool command_compare(Interpreter *tb, const char *command, size_t index, size_t length);
+line_t print_error(Interpreter *tb, const char *error, size_t index);
+line_t execute_command(Interpreter *tb, size_t index);
+Statement *stmt_slot(Interpreter *tb, size_t index, Statement *local);
+static inline bool stmt_decoded(const Statement *stmt, size_t index);
+void stmt_cache_clear(Interpreter *tb);
+#if STMT_FUSION == 1
+uint8_t decode_operand(Interpreter *tb, size_t index, size_t length, uint8_t target, var_t *value);
+size_t decode_branch(Interpreter *tb, size_t index, line_t *target);
+#endif
+static inline var_t stmt_value(Interpreter *tb, const Statement *stmt, size_t i, bool *error);
+bool decode_let(Interpreter *tb, size_t index, Statement *stmt);
+bool decode_print(Interpreter *tb, size_t index, size_t initial_index, Statement *stmt);
+bool decode_if(Interpreter *tb, size_t index, Statement *stmt);
+bool decode_goto(Interpreter *tb, size_t index, Statement *stmt);
+line_t handle_let(Interpreter *tb, size_t index);
+line_t handle_print(Interpreter *tb, size_t index);
+line_t handle_char(Interpreter *tb, size_t index);
+static inline bool compare_values(uint8_t compare, var_t left, var_t right);
+line_t handle_if(Interpreter *tb, size_t index);
+line_t handle_goto(Interpreter *tb, size_t index);
+line_t handle_input(Interpreter *tb, size_t index);
+bool edit_line(Interpreter *tb, size_t start, size_t *end, char chr);
+#if ARRAYS == 1
+void array_clear(Interpreter *tb);
+const char *array_find(Interpreter *tb, uint8_t variable, var_t element, size_t *offset);
+static inline var_t array_load(Interpreter *tb, size_t offset);
+static inline void array_store(Interpreter *tb, size_t offset, var_t value);
+bool array_assign(Interpreter *tb, const Statement *stmt, var_t value);
+line_t handle_dim(Interpreter *tb, size_t index);
+#endif
+#if CONTROL_STACK_SIZE > 0
+bool decode_for(Interpreter *tb, size_t index, Statement *stmt);
+bool control_for(Interpreter *tb, size_t index, size_t position);
+bool control_next(Interpreter *tb, size_t index, ControlFrame **resume);
+bool control_gosub(Interpreter *tb, size_t index, size_t position);
+bool control_return(Interpreter *tb, size_t index, ControlFrame **resume);
+line_t handle_control(Interpreter *tb, size_t index);
+#endif
+void handle_list(Interpreter *tb);
+#if PROFILE == 1
+static inline bool profile_before(Interpreter *tb, size_t slot_a, size_t slot_b);
+static inline void profile_line_end(LineIndex *line, unsigned long ticks);
+void handle_profile(Interpreter *tb);
+#endif
+#if STATS == 1
+void handle_stats(Interpreter *tb);
+#endif
+void handle_new(Interpreter *tb);
+void confirm_new(Interpreter *tb, char chr);
+void clear_code(Interpreter *tb);
+#if RUN_ANALYZER == 1
+bool analyze_jump(Interpreter *tb, size_t index, size_t slot);
+static inline bool analyze_value(Interpreter *tb, const Statement *stmt, size_t i);
+bool analyze_print(Interpreter *tb, size_t index);
+bool analyze_command(Interpreter *tb, size_t index, size_t slot);
+bool analyze_program(Interpreter *tb);
+#else
+size_t find_goto(Interpreter *tb, size_t index);
+bool resolve_jumps(Interpreter *tb);
+#endif
+bool run_start(Interpreter *tb);
+bool run_slice(Interpreter *tb, unsigned long lines);
+void handle_run(Interpreter *tb);
 #if POKE_PEEK == 1
-line_t handle_poke(size_t index, bool byte_size);
-line_t handle_peek(size_t index, bool byte_size);
+line_t handle_poke(Interpreter *tb, size_t index, bool byte_size);
+line_t handle_peek(Interpreter *tb, size_t index, bool byte_size);
 #endif
 #if FILE_IO == 1
-void handle_save(size_t index);
-void handle_load(size_t index);
+void handle_save(Interpreter *tb, size_t index, bool binary);
+void handle_load(Interpreter *tb, size_t index);
+bool load_file(Interpreter *tb, const char *filename);
+void image_header(uint8_t *header, size_t length);
+bool load_image(Interpreter *tb, FILE *file, const uint8_t *header);
+bool restore_code(Interpreter *tb, size_t length);
+line_t get_last_line_num(Interpreter *tb);
+line_t append_newline(Interpreter *tb, line_t last_linenum);
+#endif
+#if BATCH_MODE == 1
+int run_file(Interpreter *tb, const char *filename);
+#if STATS == 1
+void stats_json(FILE *file, const unsigned long *stats);
+#endif
+#endif
+#if BATCH_THREADS > 0
+void batch_write(BatchWorker *worker, const char *data, size_t length);
+void batch_put(void *user, char chr);
+char batch_get(void *user);
+bool batch_check(void *user);
+void batch_flush(void *user, const char *buffer, size_t length);
+size_t batch_read(void *user, char *buffer, size_t size);
+bool batch_take(BatchRunner *runner, size_t self, size_t *job);
+void *batch_worker(void *arg);
+int batch_run(const BatchJob *jobs, size_t count, size_t threads, unsigned long line_limit, unsigned long time_limit);
+bool batch_add(BatchList *list, const char *program, const char *input);
+bool batch_add_path(BatchList *list, const char *path);
+int batch_main(int argc, char **argv);
 #endif
 
 // Main functions
-bool handle_shell(void);
-void execute_newline(void);
+bool handle_shell(Interpreter *tb);
+#if INPUT_BUFFER_SIZE > 0
+bool shell_line(Interpreter *tb);
+#endif
+void execute_newline(Interpreter *tb);
+#if STEP_API == 1
+bool tb_feed_char(Interpreter *tb, char chr);
+bool tb_step(Interpreter *tb, unsigned long lines);
+#endif
+#if BENCH == 1
+void bench_put(void *user, char chr);
+char bench_get(void *user);
+bool bench_check(void *user);
+void bench_flush(void *user, const char *buffer, size_t length);
+size_t bench_read(void *user, char *buffer, size_t size);
+#endif
+#if FUZZ == 1
+static inline void fuzz_hash(uint32_t *hash, char chr);
+void fuzz_put(void *user, char chr);
+char fuzz_get(void *user);
+bool fuzz_check(void *user);
+void fuzz_flush(void *user, const char *buffer, size_t length);
+size_t fuzz_read(void *user, char *buffer, size_t size);
+uint32_t fuzz_random(FuzzProgram *program, uint32_t range);
+void fuzz_append(FuzzProgram *program, const char *text);
+void fuzz_number(FuzzProgram *program, unsigned long number, bool hex);
+void fuzz_expr(FuzzProgram *program, unsigned int depth);
+void fuzz_statement(FuzzProgram *program);
+void fuzz_generate(FuzzProgram *program, uint32_t seed);
+void fuzz_load(Interpreter *tb, const FuzzProgram *program);
+double fuzz_time(Interpreter *tb);
+void fuzz_case(Interpreter *tb, const FuzzProgram *program, FuzzResult *result);
+#endif
 
 /****************************************************************************/
 
 /**
- * Print out a string
+ * Send a character with the PUTCHAR define
  */
-void print_string(const char *string)
+void io_default_put(void *user, char chr)
 {
-  while (*string)
-    PUTCHAR(string++);
+  (void)user;
+  PUTCHAR(&chr);
 }
 
 /**
- * Print out an unsigned number
+ * Wait for a character with the GETCHAR define
  */
-void print_unsigned(uvar_t value)
+char io_default_get(void *user)
 {
-  size_t length = 1;
-  uvar_t tvalue = value;
-  while (tvalue > 9) {
-    length++;
-    tvalue /= 10;
-  }
-
-  while (length--) {
-    tvalue = value;
-    for (size_t i = 0; i < length; i++)
-      tvalue /= 10;
-    tvalue %= 10;
-    tvalue += '0';
-    PUTCHAR(&tvalue);
-  }
+  (void)user;
+  char chr;
+  GETCHAR(&chr);
+  return chr;
 }
 
 /**
- * Print out a signed number
+ * Check for the received characters with the IO_CHECK define
  */
-void print_signed(var_t value)
+bool io_default_check(void *user)
 {
-  if (value < 0) {
-    PUTCHAR("-");
-    value = -value;
-  }
-  print_unsigned(value);
+  (void)user;
+  bool received;
+  IO_CHECK(&received);
+  return received;
 }
 
-/****************************************************************************/
-
 /**
- * Skip the spaces and tabs in the new line and return the index of first non-space
+ * Send a block of characters with the FLUSH define (or one by one if it isn't used)
  */
-static inline void skip_spaces(size_t *index)
+void io_default_flush(void *user, const char *buffer, size_t length)
 {
-  while (isblank(codemem[*index]))
-    (*index)++;
+  #if OUTPUT_BUFFER_SIZE > 0 && OUTPUT_IRQ == 0
+  (void)user;
+  FLUSH(buffer, length);
+  #else
+  while (length--)
+    io_default_put(user, *buffer++);
+  #endif
 }
 
+#if defined(READ_STDIN) && INPUT_BUFFER_SIZE > 0
 /**
- * Get the number from the literal pointed to by index
+ * Read what the standard input has, a line typed on the terminal or a whole block of a file or a pipe
  */
-var_t get_literal_number(size_t index, bool *error)
+size_t read_stdin(char *buffer, size_t size)
 {
-  var_t result = 0;
-  size_t length = 0;
-  while (isalnum(codemem[index + length]) && index + length < newline_end)
-    length++;
+  const ssize_t length = read(STDIN_FILENO, buffer, size - 1);
+  return (length > 0) ? (size_t)length : 0;
+}
+#endif
 
-  // Do the binary
-  if (length > 2 && codemem[index] == '0' && codemem[index + 1] == 'b') {
-    index += 2;
-    while (isdigit(codemem[index])) {
-      char digit = codemem[index++] - '0';
+/**
+ * Read a block of the input with the READ define
+ */
+size_t io_default_read(void *user, char *buffer, size_t size)
+{
+  (void)user;
+  #if INPUT_BUFFER_SIZE > 0
+  return READ(buffer, size);
+  #else
+  (void)buffer;
+  (void)size;
+  return 0;
+  #endif
+}
+
+/**
+ * Reset the interpreter to an empty program, the IO defines are used when io is NULL
+ */
+void interpreter_init(Interpreter *tb, const InterpreterIO *io)
+{
+  static const InterpreterIO io_default = {
+    io_default_put, io_default_get, io_default_check, io_default_flush, io_default_read, NULL
+  };
+
+  // The keyword table is shared by all the interpreters
+  if (!keyword_table_valid)
+    keyword_table_build();
+
+  memset(tb, 0, sizeof(*tb));
+  tb->io = (io) ? *io : io_default;
+  #if GAP_BUFFER == 1
+  tb->gap_end = CODE_MEMORY_SIZE;
+  #endif
+  #if ARRAYS == 1
+  tb->arena_start = CODE_MEMORY_SIZE;
+  #endif
+  #if OUTPUT_IRQ == 1
+  output_owner = tb;
+  #endif
+}
+
+#if IO_KILL == 1
+/**
+ * Stop the running program before its next line, can be called from an interrupt or another thread
+ */
+void interpreter_break(Interpreter *tb)
+{
+  tb->break_request = true;
+}
+#endif
+
+#if RUN_LIMITS == 1
+#ifdef CLOCK_MONOTONIC
+/**
+ * Get the milliseconds of the monotonic clock for the RUN_CLOCK define
+ */
+unsigned long io_default_clock(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (unsigned long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+#endif
+
+/**
+ * Limit the lines and the milliseconds every run can take, 0 is no limit
+ */
+void interpreter_limit(Interpreter *tb, unsigned long lines, unsigned long ms)
+{
+  tb->line_limit = lines;
+  tb->time_limit = ms;
+}
+#endif
+
+#if INPUT_BUFFER_SIZE > 0
+/**
+ * Read more of the input after the bytes not taken yet, return false at the end of the input
+ */
+bool input_fill(Interpreter *tb)
+{
+  #if OUTPUT_BUFFER_SIZE > 0
+  output_flush(tb);
+  #endif
+
+  // Move the bytes not taken yet to the start to make space
+  if (tb->input_head) {
+    memmove(tb->input_buffer, &tb->input_buffer[tb->input_head], tb->input_tail - tb->input_head);
+    tb->input_tail -= tb->input_head;
+    tb->input_head = 0;
+  }
+  const size_t length = tb->io.read(tb->io.user, &tb->input_buffer[tb->input_tail], INPUT_BUFFER_SIZE - tb->input_tail);
+  tb->input_tail += length;
+  return length != 0;
+}
+
+/**
+ * Take the next input character, the line feed after the end of the input
+ */
+char input_char(Interpreter *tb)
+{
+  if (tb->input_head == tb->input_tail && !input_fill(tb))
+    return NEWLINE;
+  return tb->input_buffer[tb->input_head++];
+}
+
+/**
+ * Take the next input line in the buffer (without the line feed) or its part that fills it, return false at the end of the input
+ */
+bool input_line(Interpreter *tb, const char **line, size_t *length, bool *complete)
+{
+  size_t scanned = 0;
+  while (1) {
+    const char *start = &tb->input_buffer[tb->input_head];
+    const size_t unread = tb->input_tail - tb->input_head;
+    const char *end = (const char *)memchr(start + scanned, NEWLINE, unread - scanned);
+    if (end) {
+      *line = start;
+      *length = end - start;
+      *complete = true;
+      tb->input_head += *length + 1;
+      return true;
+    }
+    scanned = unread;
+
+    // The read gets space for at least one byte and the terminator, a longer line is taken in parts
+    const bool full = unread >= INPUT_BUFFER_SIZE - 1;
+    if (!full && input_fill(tb))
+      continue;
+    if (!unread)
+      return false;
+    *line = &tb->input_buffer[tb->input_head];
+    *length = unread;
+    *complete = !full;
+    tb->input_head += unread;
+    return true;
+  }
+}
+
+/**
+ * Put the input line taken from the buffer after end as if it was typed, its parts left are taken as well
+ */
+void input_copy(Interpreter *tb, const char *line, size_t length, bool complete, size_t start, size_t *end)
+{
+  while (1) {
+    // Parts with the backspaces are edited character by character
+    if (memchr(line, BACKSPACE, length)) {
+      for (size_t i = 0; i < length; i++)
+        edit_line(tb, start, end, line[i]);
+    } else {
+      #if LOOPBACK == 1
+      for (size_t i = 0; i < length; i++)
+        OUTPUT(&line[i]);
+      #endif
+
+      // Copy what fits, leave a byte for the terminator
+      const size_t free_end = codemem_free_end(tb);
+      const size_t space = (*end + 1 < free_end) ? free_end - *end - 1 : 0;
+      const size_t copied = (length < space) ? length : space;
+      memcpy(&tb->codemem[*end], line, copied);
+      *end += copied;
+    }
+
+    if (complete || !input_line(tb, &line, &length, &complete))
+      break;
+  }
+
+  #if LOOPBACK == 1
+  print_string(tb, str_lf);
+  #endif
+}
+
+/**
+ * Get the plain decimal number the line holds, return false if it's anything else
+ */
+bool input_number(const char *line, size_t length, var_t *value)
+{
+  size_t i = 0;
+  while (i < length && isblank(line[i]))
+    i++;
+  const bool negative = i < length && line[i] == '-';
+  if (negative)
+    i++;
+
+  // Leading zeros make an octal literal, it's left for the expression solver
+  const size_t digits = i;
+  uvar_t result = 0;
+  for (; i < length && isdigit(line[i]); i++) {
+    if (result > ((uvar_t)VAR_MAX - (line[i] - '0')) / 10)
+      return false;
+    result = result * 10 + (line[i] - '0');
+  }
+  if (i == digits || (line[digits] == '0' && i - digits > 1))
+    return false;
+
+  while (i < length && isblank(line[i]))
+    i++;
+  if (i != length)
+    return false;
+  *value = (negative) ? -(var_t)result : (var_t)result;
+  return true;
+}
+#endif
+
+#if OUTPUT_BUFFER_SIZE > 0
+/**
+ * Put a character into the output buffer, flush or wait if it's full
+ */
+void output_char(Interpreter *tb, char chr)
+{
+  #if OUTPUT_IRQ == 1
+  // Wait for the interrupt to make space and start it after queuing the byte
+  const outbuf_t next = (tb->output_head + 1) & (OUTPUT_BUFFER_SIZE - 1);
+  while (next == tb->output_tail);
+  tb->output_buffer[tb->output_head] = chr;
+  tb->output_head = next;
+  OUTPUT_START();
+  #else
+  if (tb->output_head == OUTPUT_BUFFER_SIZE)
+    output_flush(tb);
+  tb->output_buffer[tb->output_head++] = chr;
+  #endif
+}
+
+/**
+ * Send out everything that's in the output buffer
+ */
+void output_flush(Interpreter *tb)
+{
+  #if OUTPUT_IRQ == 1
+  while (tb->output_tail != tb->output_head);
+  #else
+  if (tb->output_head)
+    tb->io.flush(tb->io.user, tb->output_buffer, tb->output_head);
+  tb->output_head = 0;
+  #endif
+}
+
+#if OUTPUT_IRQ == 1
+/**
+ * Get the next byte to be sent from the TX interrupt, return false if there's none
+ */
+bool output_next(char *chr)
+{
+  Interpreter *tb = output_owner;
+  if (!tb || tb->output_tail == tb->output_head)
+    return false;
+  *chr = tb->output_buffer[tb->output_tail];
+  tb->output_tail = (tb->output_tail + 1) & (OUTPUT_BUFFER_SIZE - 1);
+  return true;
+}
+#endif
+#endif
+
+/**
+ * Print out a string
+ */
+void print_string(Interpreter *tb, const char *string)
+{
+  while (*string)
+    OUTPUT(string++);
+}
+
+/**
+ * Print out an unsigned number
+ */
+void print_unsigned(Interpreter *tb, uvar_t value)
+{
+  // Fill the digits from the end of the buffer, one division per digit
+  char buffer[NUMBER_BUFFER_SIZE];
+  char *digit = &buffer[NUMBER_BUFFER_SIZE - 1];
+  *digit = '\0';
+  do {
+    *--digit = (char)('0' + value % 10);
+    value /= 10;
+  } while (value);
+  print_string(tb, digit);
+}
+
+/**
+ * Print out a signed number
+ */
+void print_signed(Interpreter *tb, var_t value)
+{
+  if (value < 0) {
+    OUTPUT("-");
+    value = -value;
+  }
+  print_unsigned(tb, value);
+}
+
+/****************************************************************************/
+
+/**
+ * Skip the spaces and tabs in the new line and return the index of first non-space
+ */
+static inline void skip_spaces(Interpreter *tb, size_t *index)
+{
+  while (isblank(tb->codemem[*index]))
+    (*index)++;
+}
+
+/**
+ * Get the number from the literal pointed to by index
+ */
+var_t get_literal_number(Interpreter *tb, size_t index, bool *error)
+{
+  var_t result = 0;
+  size_t length = 0;
+  while (isalnum(tb->codemem[index + length]) && index + length < tb->newline_end)
+    length++;
+
+  // Do the binary
+  if (length > 2 && tb->codemem[index] == '0' && tb->codemem[index + 1] == 'b') {
+    index += 2;
+    while (isdigit(tb->codemem[index])) {
+      char digit = tb->codemem[index++] - '0';
       if (digit > 1) {
         *error = true;
         return 0;
@@ -348,10 +1580,10 @@ var_t get_literal_number(size_t index, bool *error)
   }
 
   // Do the hex
-  else if (length > 2 && codemem[index] == '0' && codemem[index + 1] == 'x') {
+  else if (length > 2 && tb->codemem[index] == '0' && tb->codemem[index + 1] == 'x') {
     index += 2;
-    while (isxdigit(codemem[index])) {
-      char digit = toupper(codemem[index++]);
+    while (isxdigit(tb->codemem[index])) {
+      char digit = toupper(tb->codemem[index++]);
       digit -= (digit > '9') ? 'A' - 10 : '0';
       if (digit > 16) {
         *error = true;
@@ -363,10 +1595,10 @@ var_t get_literal_number(size_t index, bool *error)
   }
 
   // Do the octal
-  else if (length > 1 && codemem[index] == '0') {
+  else if (length > 1 && tb->codemem[index] == '0') {
     index++;
-    while (isdigit(codemem[index])) {
-      char digit = codemem[index++] - '0';
+    while (isdigit(tb->codemem[index])) {
+      char digit = tb->codemem[index++] - '0';
       if (digit > 7) {
         *error = true;
         return 0;
@@ -378,9 +1610,9 @@ var_t get_literal_number(size_t index, bool *error)
 
   // Do the decimal
   else {
-    while (isdigit(codemem[index])) {
+    while (isdigit(tb->codemem[index])) {
       result *= 10;
-      result += codemem[index++] - '0';
+      result += tb->codemem[index++] - '0';
     }
   }
 
@@ -388,17 +1620,280 @@ var_t get_literal_number(size_t index, bool *error)
   return result;
 }
 
+/**
+ * Check if the character is a tokenized number literal
+ */
+static inline bool is_number_token(char chr)
+{
+  return (uint8_t)chr >= TK_NUMBER_DEC && (uint8_t)chr < TK_NUMBER_DIGIT;
+}
+
+/**
+ * Get the number (tokenized or literal) at the index and move the index after it
+ */
+var_t get_number(Interpreter *tb, size_t *index, bool *error)
+{
+  // Decode the tokenized literal
+  if (is_number_token(tb->codemem[*index])) {
+    uvar_t value = 0;
+    (*index)++;
+    while ((uint8_t)tb->codemem[*index] >= TK_NUMBER_DIGIT)
+      value = (value << 6) | ((uint8_t)tb->codemem[(*index)++] & 0x3F);
+    *error = false;
+    return (var_t)value;
+  }
+
+  // Parse the literal text
+  const var_t value = get_literal_number(tb, *index, error);
+  while (isalnum(tb->codemem[*index]))
+    (*index)++;
+  return value;
+}
+
+/****************************************************************************/
+
+/**
+ * Group the enabled keywords by their first letter
+ */
+void keyword_table_build(void)
+{
+  for (size_t i = 0; i <= 26; i++)
+    keyword_first[i] = 0;
+  for (size_t i = 0; i < KEYWORD_COUNT; i++)
+    if (keywords[i])
+      keyword_first[keywords[i][0] - 'A' + 1]++;
+  for (size_t i = 1; i <= 26; i++)
+    keyword_first[i] += keyword_first[i - 1];
+
+  // Fill the groups in the token order
+  uint8_t fill[26];
+  for (size_t i = 0; i < 26; i++)
+    fill[i] = keyword_first[i];
+  for (size_t i = 0; i < KEYWORD_COUNT; i++)
+    if (keywords[i])
+      keyword_order[fill[keywords[i][0] - 'A']++] = (uint8_t)i;
+  keyword_table_valid = true;
+}
+
+/**
+ * Get the keyword token of the word at index, 0 if it's not a keyword
+ */
+uint8_t keyword_lookup(Interpreter *tb, size_t index, size_t length)
+{
+  if (!keyword_table_valid)
+    keyword_table_build();
+
+  // Only the keywords starting with the same letter are compared
+  const size_t letter = toupper(tb->codemem[index]) - 'A';
+  for (size_t i = keyword_first[letter]; i < keyword_first[letter + 1]; i++)
+    if (command_compare(tb, keywords[keyword_order[i]], index, length))
+      return TK_CLEAR + keyword_order[i];
+  return 0;
+}
+
+/**
+ * Tokenize the number literal if it can be restored exactly, return the tokenized length
+ */
+size_t tokenize_number(Interpreter *tb, size_t index, size_t length, size_t out)
+{
+  // Get the literal format
+  uint8_t token = TK_NUMBER_DEC;
+  if (length > 2 && tb->codemem[index] == '0' && tb->codemem[index + 1] == 'b') {
+    token = TK_NUMBER_BIN;
+  } else if (length > 2 && tb->codemem[index] == '0' && tb->codemem[index + 1] == 'x') {
+    token = TK_NUMBER_HEX;
+    for (size_t i = 2; i < length; i++)
+      if (islower(tb->codemem[index + i]))
+        token = TK_NUMBER_HEX_LOWER;
+  } else if (length > 1 && tb->codemem[index] == '0') {
+    token = TK_NUMBER_OCT;
+  }
+
+  // Get the value and check if it restores to the same text
+  bool error;
+  const uvar_t value = get_literal_number(tb, index, &error);
+  if (error)
+    return 0;
+  char buffer[NUMBER_BUFFER_SIZE];
+  if (format_number(value, token, buffer) != length || strncmp(buffer, &tb->codemem[index], length))
+    return 0;
+
+  // Check if the token is shorter than the literal
+  size_t digits = 1;
+  for (uvar_t tvalue = value >> 6; tvalue; tvalue >>= 6)
+    digits++;
+  if (digits + 1 > length)
+    return 0;
+
+  // Store the token and the digits (most significant first)
+  tb->codemem[out] = token;
+  for (size_t i = 1; i <= digits; i++)
+    tb->codemem[out + i] = (char)(TK_NUMBER_DIGIT | ((value >> (6 * (digits - i))) & 0x3F));
+  return digits + 1;
+}
+
+/**
+ * Replace the keywords and number literals in the line with tokens, return the new line end
+ */
+size_t tokenize_line(Interpreter *tb, size_t index, size_t end)
+{
+  size_t out = index;
+  bool string = false;
+  while (index < end) {
+
+    // Copy the strings and non-word characters as they are
+    if (string || !isalnum(tb->codemem[index])) {
+      if (tb->codemem[index] == '"')
+        string = !string;
+      tb->codemem[out++] = tb->codemem[index++];
+      continue;
+    }
+
+    // Get the word length, a number ends at the letters after its digits (like '1THEN'), they're the next word
+    size_t length = 0;
+    if (isalpha(tb->codemem[index])) {
+      while (index + length < end && isalnum(tb->codemem[index + length]))
+        length++;
+    } else {
+      bool hex = false;
+      if (index + 1 < end && tb->codemem[index] == '0' && (tb->codemem[index + 1] == 'x' || tb->codemem[index + 1] == 'b')) {
+        hex = tb->codemem[index + 1] == 'x';
+        length = 2;
+      }
+      while (index + length < end && (isdigit(tb->codemem[index + length]) || (hex && isxdigit(tb->codemem[index + length]))))
+        length++;
+    }
+
+    // Try to replace the word with a token
+    size_t tokenized = 0;
+    if (isalpha(tb->codemem[index])) {
+      const uint8_t token = keyword_lookup(tb, index, length);
+      if (token) {
+        tb->codemem[out] = (char)token;
+        tokenized = 1;
+      }
+    } else {
+      tokenized = tokenize_number(tb, index, length, out);
+    }
+
+    // Copy the word if it wasn't tokenized
+    if (!tokenized) {
+      while (length--)
+        tb->codemem[out++] = tb->codemem[index++];
+      continue;
+    }
+    const uint8_t token = tb->codemem[out];
+    out += tokenized;
+    index += length;
+
+    // Comments and file names are left as they are
+    if (token == TK_REM || token == TK_SAVE || token == TK_BSAVE || token == TK_LOAD)
+      while (index < end)
+        tb->codemem[out++] = tb->codemem[index++];
+  }
+
+  return out;
+}
+
+/**
+ * Format the number in the literal format of the given token, return the text length
+ */
+size_t format_number(uvar_t value, uint8_t token, char *buffer)
+{
+  const char *digits = "0123456789ABCDEF";
+  uvar_t base = 10;
+  size_t length = 0;
+  switch (token) {
+    case TK_NUMBER_HEX_LOWER:
+      digits = "0123456789abcdef";
+      // fall through
+    case TK_NUMBER_HEX:
+      buffer[length++] = '0';
+      buffer[length++] = 'x';
+      base = 16;
+      break;
+    case TK_NUMBER_OCT:
+      buffer[length++] = '0';
+      base = 8;
+      break;
+    case TK_NUMBER_BIN:
+      buffer[length++] = '0';
+      buffer[length++] = 'b';
+      base = 2;
+      break;
+  }
+
+  // Put the digits in, least significant first and then reverse them
+  const size_t start = length;
+  do {
+    buffer[length++] = digits[value % base];
+    value /= base;
+  } while (value);
+  for (size_t i = start, j = length - 1; i < j; i++, j--) {
+    const char chr = buffer[i];
+    buffer[i] = buffer[j];
+    buffer[j] = chr;
+  }
+
+  buffer[length] = '\0';
+  return length;
+}
+
+/**
+ * Restore the text of the code element at the index, return the index of the next one
+ */
+size_t detokenize(Interpreter *tb, size_t index, char *buffer, uint8_t *state)
+{
+  const uint8_t chr = tb->codemem[index];
+
+  // Restore the number literal
+  if (*state == DS_CODE && is_number_token(chr)) {
+    bool error;
+    const var_t value = get_number(tb, &index, &error);
+    format_number(value, chr, buffer);
+    return index;
+  }
+
+  // Restore the keyword
+  if (*state == DS_CODE && chr >= TK_CLEAR && chr < TK_KEYWORDS_END && keywords[chr - TK_CLEAR]) {
+    strcpy(buffer, keywords[chr - TK_CLEAR]);
+    if (chr == TK_REM || chr == TK_SAVE || chr == TK_BSAVE || chr == TK_LOAD)
+      *state = DS_VERBATIM;
+    return index + 1;
+  }
+
+  // Copy everything else
+  if (chr == '"' && *state != DS_VERBATIM)
+    *state = (*state == DS_STRING) ? DS_CODE : DS_STRING;
+  buffer[0] = (char)chr;
+  buffer[1] = '\0';
+  return index + 1;
+}
+
+/**
+ * Print out the code from the index to the end of the line
+ */
+void print_code(Interpreter *tb, size_t index)
+{
+  uint8_t state = DS_CODE;
+  while (tb->codemem[index] != '\0') {
+    char buffer[NUMBER_BUFFER_SIZE];
+    index = detokenize(tb, index, buffer, &state);
+    print_string(tb, buffer);
+  }
+}
+
 /****************************************************************************/
 
 /**
  * Load the line number from possibly unaligned address
  */
-static inline line_t load_line_t(size_t index)
+static inline line_t load_line_t(Interpreter *tb, size_t index)
 {
   line_t result = 0;
   for (size_t i = sizeof(line_t); i; i--) {
     result <<= 8;
-    result |= *(uint8_t*)(&codemem[index + i - 1]);
+    result |= *(uint8_t*)(&tb->codemem[index + i - 1]);
   }
   return result;
 }
@@ -406,146 +1901,391 @@ static inline line_t load_line_t(size_t index)
 /**
  * Store the line number to possibly unaligned address
  */
-static inline void store_line_t(size_t index, line_t linenum)
+static inline void store_line_t(Interpreter *tb, size_t index, line_t linenum)
 {
   for (size_t i = 0; i < sizeof(line_t); i++) {
-    codemem[index + i] = (char)(linenum & 0xFF);
+    tb->codemem[index + i] = (char)(linenum & 0xFF);
     linenum >>= 8;
   }
 }
 
 /**
- * Get the line number from the codemem at the given index
+ * Get the line number from the tb->codemem at the given index
  */
-line_t get_line_num(size_t index)
+line_t get_line_num(Interpreter *tb, size_t index)
 {
   bool error;
-  const var_t linenum_raw = get_literal_number(index, &error);
+  const var_t linenum_raw = get_literal_number(tb, index, &error);
   if (linenum_raw <= 0 || linenum_raw >= MAX_LINENUM || error)
     return 0;
   return linenum_raw;
 }
 
 /**
- * Get the index of the line start (after line number) from codemem
+ * Get the index of the line start (after line number) from tb->codemem
  */
-size_t get_line_index(line_t linenum)
+size_t get_line_index(Interpreter *tb, line_t linenum)
 {
+  #if LINE_INDEX == 1
+  const size_t slot = line_index_find(tb, linenum);
+  if (slot < tb->line_count && tb->line_index[slot].linenum == linenum)
+    return tb->line_index[slot].index + sizeof(line_t);
+  return tb->codemem_end + sizeof(line_t);
+  #else
   size_t index = 0;
-  while (index < codemem_end) {
-    if (load_line_t(index) == linenum)
+  while (index < tb->codemem_end) {
+    if (load_line_t(tb, index) == linenum)
       break;
     index += sizeof(line_t);
-    while (codemem[index++] != '\0') {
-      if (index >= codemem_end)
+    while (tb->codemem[index++] != '\0') {
+      if (index >= tb->codemem_end)
         break;
     }
   }
 
+  STATS_ADD(ST_LINE_LOOKUPS, 1);
+  STATS_ADD(ST_LINE_SCANNED, index);
   return index + sizeof(line_t);
+  #endif
 }
 
 /**
- * Get the potential index of the line to be placed in a codemem
+ * Get the potential index of the line to be placed in a tb->codemem
  */
-size_t get_potential_line_index(line_t linenum)
+size_t get_potential_line_index(Interpreter *tb, line_t linenum)
 {
+  #if LINE_INDEX == 1
+  const size_t slot = line_index_find(tb, linenum);
+  if (slot < tb->line_count)
+    return tb->line_index[slot].index + sizeof(line_t);
+  return tb->codemem_end + sizeof(line_t);
+  #else
   size_t index = 0;
-  while (index < codemem_end) {
-    if (load_line_t(index) >= linenum)
+  while (index < tb->codemem_end) {
+    if (load_line_t(tb, index) >= linenum)
       break;
     index += sizeof(line_t);
-    while (codemem[index++] != '\0') {
-      if (index >= codemem_end)
+    while (tb->codemem[index++] != '\0') {
+      if (index >= tb->codemem_end)
         break;
     }
   }
 
   return index + sizeof(line_t);
+  #endif
 }
 
+#if LINE_INDEX == 1
 /**
- * Shift the memory contents amount bytes left
+ * Find the first slot of the line index with line number not lower than linenum
  */
-static inline void codemem_shift_left(size_t index, size_t length, size_t amount)
+size_t line_index_find(Interpreter *tb, line_t linenum)
 {
-  for (size_t i = 0; i < length; i++)
-    codemem[index - amount + i] = codemem[index + i];
+  STATS_ADD(ST_LINE_LOOKUPS, 1);
+  size_t low = 0, high = tb->line_count;
+  while (low < high) {
+    const size_t mid = (low + high) / 2;
+    if (tb->line_index[mid].linenum < linenum)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
 }
 
 /**
- * Shift the memory contents amount bytes right
+ * Insert the line to the index, lines after it get moved shift bytes right
  */
-static inline void codemem_shift_right(size_t index, size_t length, size_t amount)
+void line_index_insert(Interpreter *tb, size_t slot, line_t linenum, size_t index, size_t shift)
 {
-  while (length--)
-    codemem[index + amount + length] = codemem[index + length];
+  for (size_t i = tb->line_count; i > slot; i--) {
+    tb->line_index[i] = tb->line_index[i - 1];
+    tb->line_index[i].index += shift;
+  }
+  tb->line_index[slot].linenum = linenum;
+  tb->line_index[slot].index = index;
+  tb->line_count++;
 }
 
 /**
- * Store the new line to the memory
+ * Remove the line from the index, lines after it get moved shift bytes left
  */
-void store_newline(size_t ind)
+void line_index_remove(Interpreter *tb, size_t slot, size_t shift)
 {
-  // Get the line num
-  const line_t linenum = get_line_num(ind);
-  if (linenum == 0) {
-    print_string(str_err_linenum);
-    newline_end = newline_ind;
-    return;
+  tb->line_count--;
+  for (size_t i = slot; i < tb->line_count; i++) {
+    tb->line_index[i] = tb->line_index[i + 1];
+    tb->line_index[i].index -= shift;
   }
+}
+#endif
 
-  // Get the index after the number
-  while (isalnum(codemem[ind]) && ind < newline_end)
-    ind++;
-  skip_spaces(&ind);
-
-  // Get line indices
-  size_t lineind = get_line_index(linenum);
+/**
+ * Shift the memory contents amount bytes left
+ */
+static inline void codemem_shift_left(Interpreter *tb, size_t index, size_t length, size_t amount)
+{
+  STATS_ADD(ST_SHIFTED, length);
+  for (size_t i = 0; i < length; i++)
+    tb->codemem[index - amount + i] = tb->codemem[index + i];
+}
+
+/**
+ * Shift the memory contents amount bytes right
+ */
+static inline void codemem_shift_right(Interpreter *tb, size_t index, size_t length, size_t amount)
+{
+  STATS_ADD(ST_SHIFTED, length);
+  while (length--)
+    tb->codemem[index + amount + length] = tb->codemem[index + length];
+}
+
+/**
+ * Get the end of the free memory the new line can be put in
+ */
+static inline size_t codemem_free_end(Interpreter *tb)
+{
+  #if ARRAYS == 1
+  // Arrays are dropped before the gap opens, so only one of them can be there
+  if (tb->arena_start != CODE_MEMORY_SIZE)
+    return tb->arena_start;
+  #endif
+  #if GAP_BUFFER == 1
+  return tb->gap_end;
+  #else
+  (void)tb;
+  return CODE_MEMORY_SIZE;
+  #endif
+}
+
+#if GAP_BUFFER == 1
+/**
+ * Reverse the order of bytes in the memory
+ */
+void codemem_reverse(Interpreter *tb, size_t index, size_t length)
+{
+  for (size_t i = index, j = index + length - 1; length > 1 && i < j; i++, j--) {
+    const char chr = tb->codemem[i];
+    tb->codemem[i] = tb->codemem[j];
+    tb->codemem[j] = chr;
+  }
+}
+
+/**
+ * Swap two neighbouring blocks of the memory in place
+ */
+void codemem_rotate(Interpreter *tb, size_t index, size_t first, size_t second)
+{
+  codemem_reverse(tb, index, first);
+  codemem_reverse(tb, index + first, second);
+  codemem_reverse(tb, index, first + second);
+}
+
+/**
+ * Move the gap to the target line (index as if there was no gap), keep length bytes from its start
+ */
+void gap_move(Interpreter *tb, size_t target, size_t length)
+{
+  // Lines before the gap are moved to the end of it
+  if (target < tb->codemem_end) {
+    const size_t amount = tb->codemem_end - target;
+    STATS_ADD(ST_SHIFTED, amount);
+    codemem_rotate(tb, target, amount, length);
+    memmove(&tb->codemem[tb->gap_end - amount], &tb->codemem[target + length], amount);
+    tb->codemem_end = target;
+    tb->gap_end -= amount;
+  }
+
+  // Lines after the gap are moved to the start of it
+  else if (target > tb->codemem_end) {
+    const size_t amount = target - tb->codemem_end;
+    STATS_ADD(ST_SHIFTED, amount);
+    memmove(&tb->codemem[tb->gap_end - length], &tb->codemem[tb->codemem_end], length);
+    codemem_rotate(tb, tb->gap_end - length, length, amount);
+    memmove(&tb->codemem[tb->codemem_end], &tb->codemem[tb->gap_end - length], amount + length);
+    tb->codemem_end += amount;
+    tb->gap_end += amount;
+  }
+}
+
+/**
+ * Join the lines after the gap back to the rest, keep the new line buffer after them
+ */
+void gap_close(Interpreter *tb)
+{
+  if (tb->gap_end == CODE_MEMORY_SIZE)
+    return;
+  const size_t amount = CODE_MEMORY_SIZE - tb->gap_end;
+  gap_move(tb, tb->codemem_end + amount, tb->newline_end - tb->codemem_end);
+  tb->newline_ind += amount;
+  tb->newline_end += amount;
+}
+
+/**
+ * Get the index of the line header (as if there was no gap) where the line is or would be placed
+ */
+size_t gap_find_line(Interpreter *tb, line_t linenum, bool *found)
+{
+  #if LINE_INDEX == 1
+  const size_t slot = line_index_find(tb, linenum);
+  *found = slot < tb->line_count && tb->line_index[slot].linenum == linenum;
+  if (slot < tb->line_count)
+    return tb->line_index[slot].index;
+  return tb->codemem_end + CODE_MEMORY_SIZE - tb->gap_end;
+  #else
+  size_t index = 0;
+  while (1) {
+    if (index == tb->codemem_end)
+      index = tb->gap_end;
+    if (index >= CODE_MEMORY_SIZE || load_line_t(tb, index) >= linenum)
+      break;
+    index += sizeof(line_t);
+    index += strlen(&tb->codemem[index]) + 1;
+  }
+
+  *found = index < CODE_MEMORY_SIZE && load_line_t(tb, index) == linenum;
+  return (index >= tb->gap_end) ? index - (tb->gap_end - tb->codemem_end) : index;
+  #endif
+}
+#endif
+
+/**
+ * Drop everything that was kept about the code (the code memory has changed)
+ */
+static void code_changed(Interpreter *tb)
+{
+  #if EXPR_RPN == 1 && EXPR_CACHE_SIZE > 0
+  expr_cache_clear(tb);
+  #endif
+  stmt_cache_clear(tb);
+  #if ARRAYS == 1
+  array_clear(tb);
+  #endif
+}
+
+/**
+ * Store the new line to the memory
+ */
+void store_newline(Interpreter *tb, size_t ind)
+{
+  // Get the line num
+  const line_t linenum = get_line_num(tb, ind);
+  if (linenum == 0) {
+    print_string(tb, str_err_linenum);
+    tb->error_reported = true;
+    tb->newline_end = tb->newline_ind;
+    return;
+  }
+
+  // Get the index after the number
+  while (isalnum(tb->codemem[ind]) && ind < tb->newline_end)
+    ind++;
+  skip_spaces(tb, &ind);
+
+  // Tokenize the line in place
+  tb->newline_end = tokenize_line(tb, ind, tb->newline_end);
+
+  code_changed(tb);
+
+  #if GAP_BUFFER == 1
+  // Get the line index and the line length without the trailing whitespaces
+  bool found;
+  const size_t lineind = gap_find_line(tb, linenum, &found);
+  size_t newlinelen = tb->newline_end - ind;
+  while (newlinelen && isblank(tb->codemem[ind + newlinelen - 1]))
+    newlinelen--;
+  if (!found && !newlinelen)
+    return;
+
+  // Move the gap to the line, the new line buffer goes with it
+  const size_t offset = ind - tb->codemem_end;
+  gap_move(tb, lineind, tb->newline_end - tb->codemem_end);
+  ind = tb->codemem_end + offset;
+
+  // Delete the line if it exists, it's the first one after the gap
+  if (found) {
+    const size_t linelen = strlen(&tb->codemem[tb->gap_end + sizeof(line_t)]) + sizeof(line_t) + 1;
+    tb->gap_end += linelen;
+    #if LINE_INDEX == 1
+    line_index_remove(tb, line_index_find(tb, linenum), linelen);
+    #endif
+  }
+
+  // Check if the line is non-empty
+  if (newlinelen) {
+
+    // Check if there's memory for the command
+    if (tb->gap_end - tb->codemem_end < newlinelen + 8) {
+      print_string(tb, str_err_out_of_memory);
+      tb->error_reported = true;
+      return;
+    }
+
+    // Put the line in front of the gap
+    memmove(&tb->codemem[lineind + sizeof(line_t)], &tb->codemem[ind], newlinelen);
+    store_line_t(tb, lineind, linenum);
+    tb->codemem[lineind + newlinelen + sizeof(line_t)] = '\0';
+    const size_t shift_amount = newlinelen + sizeof(line_t) + 1;
+    tb->codemem_end += shift_amount;
+    #if LINE_INDEX == 1
+    line_index_insert(tb, line_index_find(tb, linenum), linenum, lineind, shift_amount);
+    #endif
+  }
+  #else
+  // Get line indices
+  size_t lineind = get_line_index(tb, linenum);
 
   // Delete the line if it exists
-  if (lineind < codemem_end) {
+  if (lineind < tb->codemem_end) {
     lineind -= sizeof(line_t);
-    const size_t linelen = strlen(&codemem[lineind + sizeof(line_t)]) + sizeof(line_t) + 1;
-    const size_t shift_length = codemem_end - (lineind + linelen);
-    codemem_shift_left(lineind + linelen, shift_length, linelen);
-    codemem_end -= linelen;
+    const size_t linelen = strlen(&tb->codemem[lineind + sizeof(line_t)]) + sizeof(line_t) + 1;
+    const size_t shift_length = tb->codemem_end - (lineind + linelen);
+    codemem_shift_left(tb, lineind + linelen, shift_length, linelen);
+    tb->codemem_end -= linelen;
+    #if LINE_INDEX == 1
+    line_index_remove(tb, line_index_find(tb, linenum), linelen);
+    #endif
   } else {
-    lineind = get_potential_line_index(linenum) - sizeof(line_t);
+    lineind = get_potential_line_index(tb, linenum) - sizeof(line_t);
   }
 
   // Check if the line is non-empty
-  size_t newlinelen = newline_end - ind;
+  size_t newlinelen = tb->newline_end - ind;
   if (newlinelen) {
 
     // Clear the whitespaces after the command
-    while (isblank(codemem[ind + newlinelen - 1]))
+    while (isblank(tb->codemem[ind + newlinelen - 1]))
       newlinelen--;
 
     // Check if there's memory for the command
-    if (CODE_MEMORY_SIZE - codemem_end < newlinelen + 8) {
-      print_string(str_err_out_of_memory);
+    if (CODE_MEMORY_SIZE - tb->codemem_end < newlinelen + 8) {
+      print_string(tb, str_err_out_of_memory);
+      tb->error_reported = true;
       return;
     }
 
     // Copy the line to the end of the memory
     for (size_t i = 0; i < newlinelen; i++)
-      codemem[CODE_MEMORY_SIZE - newlinelen + i] = codemem[ind + i];
+      tb->codemem[CODE_MEMORY_SIZE - newlinelen + i] = tb->codemem[ind + i];
 
     // Make space for a new line
     size_t shift_amount = newlinelen + sizeof(line_t) + 1;
-    if (lineind < codemem_end) {
-      size_t shift_length = codemem_end - lineind;
-      codemem_shift_right(lineind, shift_length, shift_amount);
+    if (lineind < tb->codemem_end) {
+      size_t shift_length = tb->codemem_end - lineind;
+      codemem_shift_right(tb, lineind, shift_length, shift_amount);
     }
-    codemem_end += shift_amount;
+    tb->codemem_end += shift_amount;
+    #if LINE_INDEX == 1
+    line_index_insert(tb, line_index_find(tb, linenum), linenum, lineind, shift_amount);
+    #endif
 
     // Copy the line into it's new place
-    store_line_t(lineind, linenum);
-    codemem[lineind + newlinelen + sizeof(line_t)] = '\0';
+    store_line_t(tb, lineind, linenum);
+    tb->codemem[lineind + newlinelen + sizeof(line_t)] = '\0';
     for (size_t i = 0; i < newlinelen; i++)
-      codemem[lineind + sizeof(line_t) + i] = codemem[CODE_MEMORY_SIZE - newlinelen + i];
+      tb->codemem[lineind + sizeof(line_t) + i] = tb->codemem[CODE_MEMORY_SIZE - newlinelen + i];
   }
+  #endif
 }
 
 /****************************************************************************/
@@ -553,1195 +2293,4358 @@ void store_newline(size_t ind)
 /**
  * Solve the expression and return the result
  */
-var_t expr_solve(size_t index, size_t length, bool *error)
+var_t expr_solve(Interpreter *tb, size_t index, size_t length, bool *error)
 {
+  BENCH_COUNT(exprs);
+  STATS_ADD(ST_EXPRS, 1);
+  const char *fault;
+
+  #if EXPR_RPN == 1
+  // Use the compiled program if the expression was seen before
+  #if EXPR_CACHE_SIZE > 0
+  ExprCache *cache = NULL;
+  if (index < tb->codemem_end) {
+    cache = expr_cache_find(tb, index, length);
+    if (cache->length == length && cache->index == index)
+      return expr_evaluate(tb, &tb->expr_cache_type[cache->start], &tb->expr_cache_value[cache->start],
+        cache->count, index, error);
+  }
+  #endif
+
+  // Compile the expression to postfix order
+  fault = expr_tokenize(tb, index, length);
+  if (fault)
+    goto handle_expr_error;
+
+  fault = str_err_expression;
+  if (expr_compile(tb))
+    goto handle_expr_error;
+
+  #if EXPR_DEBUG == 1
+  for (int i = 0; i < tb->expr_token_count; i++)
+    printf("Type %d, Value 0x%lx (%ld)\n", tb->expr_tokens.type[i],
+      tb->expr_tokens.value[i], tb->expr_tokens.value[i]); // NOLINT
+  #endif
+
+  #if EXPR_CACHE_SIZE > 0
+  if (cache)
+    expr_cache_store(tb, cache, index, length);
+  #endif
+
+  // Solve the expression
+  return expr_evaluate(tb, tb->expr_tokens.type, tb->expr_tokens.value, tb->expr_token_count, index, error);
+  #else
   // Do the expression things
-  expr_token_count = 0;
-  expr_tokenize(index, length);
-  if (expr_token_count == EXPR_MAX_TOKENS)
+  fault = expr_tokenize(tb, index, length);
+  if (fault)
     goto handle_expr_error;
 
-  if (expr_reduce_unary())
+  // Get the variable values
+  for (size_t i = 0; i < tb->expr_token_count; i++) {
+    if (tb->expr_tokens.type[i] == ET_VARIABLE) {
+      tb->expr_tokens.type[i] = ET_VALUE;
+      tb->expr_tokens.value[i] = tb->variables[tb->expr_tokens.value[i]];
+    }
+  }
+
+  fault = str_err_expression;
+  if (expr_reduce_unary(tb))
     goto handle_expr_error;
 
-  if (expr_calc_precedence())
+  if (expr_calc_precedence(tb))
     goto handle_expr_error;
 
-  expr_filter_brackets();
+  expr_filter_brackets(tb);
 
   #if EXPR_DEBUG == 1
-  for (int i = 0; i < expr_token_count; i++)
-    printf("Type %d, Precedence %2d, Value 0x%lx (%ld)\n", expr_tokens[i].type,
-      expr_tokens[i].precedence, expr_tokens[i].value, expr_tokens[i].value); // NOLINT
+  for (int i = 0; i < tb->expr_token_count; i++)
+    printf("Type %d, Precedence %2d, Value 0x%lx (%ld)\n", tb->expr_tokens.type[i],
+      tb->expr_tokens.precedence[i], tb->expr_tokens.value[i], tb->expr_tokens.value[i]); // NOLINT
   #endif
 
   // Solve the expression
-  while (expr_token_count > 1)
-    if (expr_reduce())
+  while (tb->expr_token_count > 1) {
+    STATS_ADD(ST_EXPR_TOKENS, tb->expr_token_count);
+    fault = expr_reduce(tb);
+    if (fault)
       goto handle_expr_error;
+  }
 
   // Return the result
   *error = 0;
-  return expr_tokens[0].value;
+  return tb->expr_tokens.value[0];
+  #endif
 
-  // Syntax error
+  // Syntax or arithmetic error
   handle_expr_error:
-  print_error(str_err_expression, index);
+  print_error(tb, fault, index);
   *error = 1;
   return 0;
 }
 
 /**
- * Tokenize the expression
+ * Check the expression syntax without solving it and keep it compiled, return true if it's invalid
+ */
+bool expr_check(Interpreter *tb, size_t index, size_t length)
+{
+  #if EXPR_RPN == 1 && EXPR_CACHE_SIZE > 0
+  ExprCache *cache = expr_cache_find(tb, index, length);
+  if (cache->length == length && cache->index == index)
+    return false;
+  #endif
+
+  const char *fault = expr_tokenize(tb, index, length);
+  #if EXPR_RPN == 1
+  if (!fault && expr_compile(tb))
+    fault = str_err_expression;
+  #if EXPR_CACHE_SIZE > 0
+  if (!fault)
+    expr_cache_store(tb, cache, index, length);
+  #endif
+  #endif
+
+  if (fault) {
+    print_error(tb, fault, index);
+    return true;
+  }
+  return false;
+}
+
+/**
+ * Tokenize the expression, return the error if it's invalid or doesn't fit in the tokens
  */
-void expr_tokenize(size_t index, size_t length)
+const char *expr_tokenize(Interpreter *tb, size_t index, size_t length)
 {
+  STATS_ADD(ST_EXPR_COMPILES, 1);
+  tb->expr_token_count = 0;
   length += index;
-  while (1)
+  while (index < length)
   {
-    // Check for the end
-    if (expr_token_count == EXPR_MAX_TOKENS)
-      break;
-    if (index >= length)
-      break;
-
-    ExprToken tok;
-    tok.type = ET_NONE;
-    tok.precedence = 0;
-    tok.value = 0;
+    uint8_t type = ET_NONE;
+    var_t value = 0;
 
     // Check for the literals
-    if (isdigit(codemem[index])) {
+    if (isdigit(tb->codemem[index]) || is_number_token(tb->codemem[index])) {
       bool error;
-      tok.type = ET_VALUE;
-      tok.value = get_literal_number(index, &error);
-      if (error) {
-        expr_token_count = EXPR_MAX_TOKENS;
-        break;
-      }
-      while (isalnum(codemem[index]))
-        index++;
+      type = ET_VALUE;
+      value = get_number(tb, &index, &error);
+      if (error)
+        return str_err_expression;
       index--;
     }
 
     // Check for the variables
-    else if (isalpha(codemem[index])) {
-      tok.type = ET_VALUE;
-      tok.value = variables[toupper(codemem[index]) - 'A'];
+    else if (isalpha(tb->codemem[index])) {
+      type = ET_VARIABLE;
+      value = toupper(tb->codemem[index]) - 'A';
+      #if ARRAYS == 1
+      // Array element, the bracket after the variable holds the index
+      size_t next = index + 1;
+      while (next < length && isblank(tb->codemem[next]))
+        next++;
+      if (next < length && tb->codemem[next] == '(') {
+        type = ET_ARRAY_OPEN;
+        index = next;
+      }
+      #endif
     }
 
     // Check the remaining tokens
-    else switch (codemem[index]) {
+    else switch (tb->codemem[index]) {
       case ' ':
       case '\t':
         break;
 
       case '+':
-        tok.type = ET_ADD;
+        type = ET_ADD;
         break;
 
       case '-':
-        tok.type = ET_SUBTRACT;
+        type = ET_SUBTRACT;
         break;
 
       case '*':
-        tok.type = ET_MULTIPLY;
+        type = ET_MULTIPLY;
         break;
 
       case '/':
-        tok.type = ET_DIVIDE;
+        type = ET_DIVIDE;
         break;
 
       case '%':
-        tok.type = ET_REMAINDER;
+        type = ET_REMAINDER;
         break;
 
       case '&':
-        tok.type = ET_AND;
+        type = ET_AND;
         break;
 
       case '|':
-        tok.type = ET_OR;
+        type = ET_OR;
         break;
 
       case '^':
-        tok.type = ET_XOR;
+        type = ET_XOR;
         break;
 
       case '!':
-        tok.type = ET_INVERT;
+        type = ET_INVERT;
         break;
 
       case '(':
-        tok.type = ET_SUBEXPR_OPEN;
+        type = ET_SUBEXPR_OPEN;
         break;
 
       case ')':
-        tok.type = ET_SUBEXPR_CLOSE;
+        type = ET_SUBEXPR_CLOSE;
         break;
 
       default:
-        expr_token_count = EXPR_MAX_TOKENS;
+        return str_err_expression;
     }
 
-    if (tok.type != ET_NONE)
-      expr_tokens[expr_token_count++] = tok;
+    if (type != ET_NONE) {
+      if (tb->expr_token_count == EXPR_MAX_TOKENS)
+        return str_err_expr_long;
+      tb->expr_tokens.type[tb->expr_token_count] = type;
+      tb->expr_tokens.value[tb->expr_token_count] = value;
+      #if EXPR_RPN == 0
+      tb->expr_tokens.precedence[tb->expr_token_count] = 0;
+      #endif
+      tb->expr_token_count++;
+    }
 
     index++;
   }
+  return NULL;
 }
 
 /**
- * Calculate expression precedence
+ * Divide or get the remainder in place, return the error if it can't be done
  */
-bool expr_calc_precedence(void)
+static inline const char *expr_divide(uint8_t type, var_t *left, var_t right)
 {
-  int8_t base_precedence = 0;
-  for (size_t i = 0; i < expr_token_count; i++) {
-    switch (expr_tokens[i].type) {
-
-      case ET_AND:
-      case ET_OR:
-      case ET_XOR:
-        expr_tokens[i].precedence = base_precedence + 1;
-        break;
-
-      case ET_ADD:
-      case ET_SUBTRACT:
-        expr_tokens[i].precedence = base_precedence + 2;
-        break;
-
-      case ET_MULTIPLY:
-      case ET_DIVIDE:
-      case ET_REMAINDER:
-        expr_tokens[i].precedence = base_precedence + 3;
-        break;
-
-      case ET_SUBEXPR_OPEN:
-        base_precedence += ET_SUBEXPR;
-        break;
+  if (!right)
+    return str_err_divide_zero;
 
-      case ET_SUBEXPR_CLOSE:
-        base_precedence -= ET_SUBEXPR;
-        break;
+  // The minimum value divided by -1 traps on most CPUs, so it's negated instead
+  if (right == -1) {
+    if (type == ET_REMAINDER) {
+      *left = 0;
+    } else {
+      #if EXPR_CHECKED == 1
+      if (*left == VAR_MIN)
+        return str_err_overflow;
+      #endif
+      *left = (var_t)(0 - (uvar_t)*left);
     }
-
-    if (base_precedence < 0)
-      return 1;
+    return NULL;
   }
 
-  return !!base_precedence;
+  if (type == ET_DIVIDE)
+    *left /= right;
+  else
+    *left %= right;
+  return NULL;
 }
 
+#if EXPR_CHECKED == 1
 /**
- * Filter the brackets from the expression
+ * Add, subtract or multiply the values, return true if the result doesn't fit in var_t
  */
-void expr_filter_brackets(void)
+static inline bool expr_overflow(uint8_t type, var_t left, var_t right, var_t *result)
 {
-  size_t index = 0, newindex = 0;
-  for (; index < expr_token_count; index++) {
-    const uint8_t type = expr_tokens[index].type;
-    if (type != ET_SUBEXPR_OPEN && type != ET_SUBEXPR_CLOSE)
-      expr_tokens[newindex++] = expr_tokens[index];
+  #if defined(__GNUC__)
+  if (type == ET_ADD)
+    return __builtin_add_overflow(left, right, result);
+  if (type == ET_SUBTRACT)
+    return __builtin_sub_overflow(left, right, result);
+  return __builtin_mul_overflow(left, right, result);
+  #else
+  if (type == ET_ADD) {
+    if ((right > 0 && left > VAR_MAX - right) || (right < 0 && left < VAR_MIN - right))
+      return true;
+    *result = left + right;
+  } else if (type == ET_SUBTRACT) {
+    if ((right < 0 && left > VAR_MAX + right) || (right > 0 && left < VAR_MIN + right))
+      return true;
+    *result = left - right;
+  } else {
+    if (left > 0 && right > 0 && left > VAR_MAX / right)
+      return true;
+    if (left > 0 && right < 0 && right < VAR_MIN / left)
+      return true;
+    if (left < 0 && right > 0 && left < VAR_MIN / right)
+      return true;
+    if (left < 0 && right < 0 && right < VAR_MAX / left)
+      return true;
+    *result = left * right;
   }
-  expr_token_count = newindex;
+  return false;
+  #endif
 }
+#endif
 
+#if EXPR_RPN == 1
 /**
- * Try to solve highest precedence operation
+ * Get the precedence of the operator
  */
-bool expr_reduce(void)
+static inline uint8_t expr_precedence(uint8_t type)
 {
-  // Find most important operation index
-  uint8_t prec = 0;
-  size_t index = 0;
-  for (size_t i = 0; i < expr_token_count; i++) {
-    if (expr_tokens[i].precedence > prec) {
-      prec = expr_tokens[i].precedence;
-      index = i;
-    }
-  }
+  switch (type) {
+    case ET_AND:
+    case ET_OR:
+    case ET_XOR:
+      return 1;
 
-  // Return 1 if no operation can be performed
-  if (!prec)
-    return 1;
+    case ET_ADD:
+    case ET_SUBTRACT:
+      return 2;
 
-  // Do the multiplication
-  if (expr_tokens[index].type == ET_MULTIPLY) {
-    if (expr_reduce_check(index))
-      return 1;
-    expr_tokens[index - 1].value *= expr_tokens[index + 1].value;
-    expr_erase(index, 2);
-    return 0;
-  }
+    case ET_MULTIPLY:
+    case ET_DIVIDE:
+    case ET_REMAINDER:
+      return 3;
 
-  // Do the division
-  else if (expr_tokens[index].type == ET_DIVIDE) {
-    if (expr_reduce_check(index))
-      return 1;
-    expr_tokens[index - 1].value /= expr_tokens[index + 1].value;
-    expr_erase(index, 2);
-    return 0;
+    case ET_NEGATE:
+    case ET_INVERT:
+      return 4;
   }
+  return 0;
+}
 
-  // Do the remainder
-  else if (expr_tokens[index].type == ET_REMAINDER) {
-    if (expr_reduce_check(index))
-      return 1;
-    expr_tokens[index - 1].value %= expr_tokens[index + 1].value;
-    expr_erase(index, 2);
-    return 0;
-  }
+/**
+ * Convert the expression tokens to postfix order in place (shunting-yard)
+ */
+bool expr_compile(Interpreter *tb)
+{
+  uint8_t stack[EXPR_MAX_TOKENS];
+  size_t depth = 0, count = 0;
+  bool operand = true;
+
+  for (size_t i = 0; i < tb->expr_token_count; i++) {
+    const uint8_t type = tb->expr_tokens.type[i];
+    switch (type) {
+
+      // Values go straight to the output
+      case ET_VALUE:
+      case ET_VARIABLE:
+        if (!operand)
+          return 1;
+        tb->expr_tokens.type[count] = type;
+        tb->expr_tokens.value[count++] = tb->expr_tokens.value[i];
+        operand = false;
+        break;
 
-  // Do the addition
-  else if (expr_tokens[index].type == ET_ADD) {
-    if (expr_reduce_check(index))
-      return 1;
-    expr_tokens[index - 1].value += expr_tokens[index + 1].value;
-    expr_erase(index, 2);
-    return 0;
-  }
+      case ET_SUBEXPR_OPEN:
+        if (!operand)
+          return 1;
+        stack[depth++] = ET_SUBEXPR_OPEN;
+        break;
 
-  // Do the subtraction
-  else if (expr_tokens[index].type == ET_SUBTRACT) {
-    if (expr_reduce_check(index))
-      return 1;
-    expr_tokens[index - 1].value -= expr_tokens[index + 1].value;
-    expr_erase(index, 2);
-    return 0;
-  }
+      #if ARRAYS == 1
+      // The letter and the array go under the bracket and are output after it's closed
+      case ET_ARRAY_OPEN:
+        if (!operand || depth + 3 > EXPR_MAX_TOKENS)
+          return 1;
+        stack[depth++] = (uint8_t)tb->expr_tokens.value[i];
+        stack[depth++] = ET_ARRAY;
+        stack[depth++] = ET_SUBEXPR_OPEN;
+        break;
+      #endif
 
-  // Do the AND
-  else if (expr_tokens[index].type == ET_AND) {
-    if (expr_reduce_check(index))
-      return 1;
-    expr_tokens[index - 1].value &= expr_tokens[index + 1].value;
-    expr_erase(index, 2);
-    return 0;
-  }
+      // Output the operators until the matching bracket
+      case ET_SUBEXPR_CLOSE:
+        if (operand)
+          return 1;
+        while (depth && stack[depth - 1] != ET_SUBEXPR_OPEN)
+          tb->expr_tokens.type[count++] = stack[--depth];
+        if (!depth)
+          return 1;
+        depth--;
+        #if ARRAYS == 1
+        if (depth && stack[depth - 1] == ET_ARRAY) {
+          tb->expr_tokens.type[count] = ET_ARRAY;
+          tb->expr_tokens.value[count++] = stack[depth - 2];
+          depth -= 2;
+        }
+        #endif
+        break;
 
- // Do the OR
-  else if (expr_tokens[index].type == ET_OR) {
-    if (expr_reduce_check(index))
-      return 1;
-    expr_tokens[index - 1].value |= expr_tokens[index + 1].value;
-    expr_erase(index, 2);
-    return 0;
+      default:
+
+        // Unary operators (unary plus does nothing)
+        if (operand) {
+          if (type == ET_SUBTRACT)
+            stack[depth++] = ET_NEGATE;
+          else if (type == ET_INVERT)
+            stack[depth++] = ET_INVERT;
+          else if (type != ET_ADD)
+            return 1;
+          break;
+        }
+
+        // Binary operators, output the ones with the same or higher precedence first
+        if (type == ET_INVERT)
+          return 1;
+        const uint8_t precedence = expr_precedence(type);
+        while (depth && stack[depth - 1] != ET_SUBEXPR_OPEN &&
+            expr_precedence(stack[depth - 1]) >= precedence)
+          tb->expr_tokens.type[count++] = stack[--depth];
+        stack[depth++] = type;
+        operand = true;
+    }
   }
 
- // Do the XOR
-  else if (expr_tokens[index].type == ET_XOR) {
-    if (expr_reduce_check(index))
+  // Output the remaining operators
+  if (operand)
+    return 1;
+  while (depth) {
+    if (stack[depth - 1] == ET_SUBEXPR_OPEN)
       return 1;
-    expr_tokens[index - 1].value ^= expr_tokens[index + 1].value;
-    expr_erase(index, 2);
-    return 0;
+    tb->expr_tokens.type[count++] = stack[--depth];
   }
 
-  return 1;
-}
-
-/**
- * Reduce the unary operators
- */
-bool expr_reduce_unary(void)
-{
-  for (size_t i = expr_token_count; i > 0; i--)
-  {
-    if (expr_tokens[i].type == ET_SUBEXPR_OPEN)
-      continue;
-    if (i > 1 && expr_tokens[i - 2].type == ET_VALUE)
-      continue;
-    if (i > 1 && expr_tokens[i - 2].type == ET_SUBEXPR_CLOSE)
-      continue;
-
-    if (expr_tokens[i - 1].type == ET_ADD) {
-      if (expr_tokens[i].type != ET_VALUE)
-        return 1;
-      expr_erase(i - 1, 1);
-    } else if (expr_tokens[i - 1].type == ET_SUBTRACT) {
-      if (expr_tokens[i].type != ET_VALUE)
-        return 1;
-      expr_tokens[i].value *= -1;
-      expr_erase(i - 1, 1);
-    } else if (expr_tokens[i - 1].type == ET_INVERT) {
-      if (expr_tokens[i].type != ET_VALUE)
-        return 1;
-      expr_tokens[i].value = ~expr_tokens[i].value;
-      expr_erase(i - 1, 1);
+  // Power of 2 constants (the right operand is the value just before the operator) become shifts
+  size_t out = 0;
+  for (size_t i = 0; i < count; i++) {
+    const uint8_t type = tb->expr_tokens.type[i];
+    if (out && tb->expr_tokens.type[out - 1] == ET_VALUE &&
+        (type == ET_MULTIPLY || type == ET_DIVIDE || type == ET_REMAINDER)) {
+      const var_t value = tb->expr_tokens.value[out - 1];
+      if (value > 0 && !(value & (value - 1))) {
+        var_t shift = 0;
+        while (((var_t)1 << shift) != value)
+          shift++;
+        tb->expr_tokens.type[out - 1] = (type == ET_MULTIPLY) ? ET_SHIFT_LEFT :
+          (type == ET_DIVIDE) ? ET_SHIFT_RIGHT : ET_MASK;
+        tb->expr_tokens.value[out - 1] = shift;
+        continue;
+      }
     }
+    tb->expr_tokens.type[out] = type;
+    tb->expr_tokens.value[out++] = tb->expr_tokens.value[i];
   }
 
+  tb->expr_token_count = out;
   return 0;
 }
 
 /**
- * Check if the operation is valid
+ * Evaluate the postfix expression program, arithmetic errors are reported at the index
  */
-bool expr_reduce_check(size_t index)
+var_t expr_evaluate(Interpreter *tb, const uint8_t *types, const var_t *values, size_t count, size_t index, bool *error)
 {
-  if (index == 0 || index == expr_token_count)
-    return 1;
-
-  if (expr_tokens[index - 1].type != ET_VALUE)
-    return 1;
+  const char *fault;
+  var_t stack[EXPR_MAX_TOKENS];
+  size_t depth = 0;
+  STATS_ADD(ST_EXPR_TOKENS, count);
+
+  // Every operation has its own case, so it's a single jump table
+  for (size_t i = 0; i < count; i++) {
+    var_t *top = &stack[depth]; // Above the top value
+    switch (types[i]) {
+      case ET_VALUE:
+        stack[depth++] = values[i];
+        break;
 
-  if (expr_tokens[index + 1].type != ET_VALUE)
-    return 1;
+      case ET_VARIABLE:
+        stack[depth++] = tb->variables[values[i]];
+        break;
 
-  return 0;
-}
+      case ET_NEGATE:
+        #if EXPR_CHECKED == 1
+        if (top[-1] == VAR_MIN)
+          goto handle_overflow;
+        #endif
+        top[-1] = (var_t)(0 - (uvar_t)top[-1]);
+        break;
 
-/**
- * Erase length tokens at index
- */
-void expr_erase(size_t index, size_t length)
-{
-  for (size_t i = index; i < expr_token_count - length; i++)
-    expr_tokens[i] = expr_tokens[i + length];
-  expr_token_count -= length;
-}
+      case ET_INVERT:
+        top[-1] = ~top[-1];
+        break;
 
-/****************************************************************************/
+      // Power of 2 constant multiply, divide and remainder (the value is the shift)
+      case ET_SHIFT_LEFT:
+        #if EXPR_CHECKED == 1
+        if (top[-1] > (VAR_MAX >> values[i]) || top[-1] < -(VAR_MAX >> values[i]) - 1)
+          goto handle_overflow;
+        #endif
+        top[-1] = (var_t)((uvar_t)top[-1] << values[i]);
+        break;
 
-/**
- * Compare the memory contents to the given command
- */
-bool command_compare(const char *command, size_t index)
-{
-  size_t i;
-  for (i = 0; command[i]; i++)
-    if (command[i] != toupper(codemem[index + i]))
-      return false;
-  return (codemem[index + i] == '\0' || codemem[index + i] == ' ');
-}
-
-/**
- * Show the error
- */
-line_t print_error(const char *error, size_t index)
-{
-  if (current_line) {
-    print_string(str_err_at_line1);
-    print_unsigned(current_line);
-    print_string(str_err_at_line2);
-    print_string(error);
-    print_string(str_lf);
-    print_unsigned(current_line);
-    print_string(str_space);
-    print_string(&codemem[index]);
-    print_string(str_lf);
-  } else {
-    print_string(str_err);
-    print_string(error);
-    print_string(str_lf);
-    print_string(&codemem[index]);
-    print_string(str_lf);
-  }
-  return MAX_LINENUM;
-}
+      case ET_SHIFT_RIGHT: {
+        // Round towards zero like the division does
+        const var_t biased = (top[-1] < 0) ? top[-1] + (((var_t)1 << values[i]) - 1) : top[-1];
+        top[-1] = (biased >= 0) ? biased >> values[i] : ~(~biased >> values[i]);
+        break;
+      }
 
-/**
- * Detect the command and call the appropriate method on it and return next line address
- */
-line_t execute_command(size_t index)
-{
-  bool error = false;
+      case ET_MASK: {
+        const uvar_t mask = ((uvar_t)1 << values[i]) - 1;
+        top[-1] = (top[-1] >= 0) ? (var_t)((uvar_t)top[-1] & mask) : -(var_t)((0 - (uvar_t)top[-1]) & mask);
+        break;
+      }
 
-  // Execute "LET"
-  if (command_compare(kwd_let, index)) {
-    return handle_let(index + strlen(kwd_list));
-  }
+      #if ARRAYS == 1
+      // The index is replaced by the element
+      case ET_ARRAY: {
+        size_t offset = 0;
+        fault = array_find(tb, (uint8_t)values[i], top[-1], &offset);
+        if (fault)
+          goto handle_fault;
+        top[-1] = array_load(tb, offset);
+        break;
+      }
+      #endif
 
-  // Execute "LET" without the keyword
-  else if (isalpha(codemem[index]) && (codemem[index + 1] == ' ' || codemem[index + 1] == '=')) {
-    return handle_let(index);
-  }
+      // Binary operators, the result replaces the left operand
+      case ET_MULTIPLY:
+        depth--;
+        #if EXPR_CHECKED == 1
+        if (expr_overflow(ET_MULTIPLY, top[-2], top[-1], &top[-2]))
+          goto handle_overflow;
+        #else
+        top[-2] = (var_t)((uvar_t)top[-2] * (uvar_t)top[-1]);
+        #endif
+        break;
 
-  // Execute "PRINT"
-  else if (command_compare(kwd_print, index)) {
-    return handle_print(index);
-  }
+      case ET_DIVIDE:
+      case ET_REMAINDER: {
+        depth--;
+        fault = expr_divide(types[i], &top[-2], top[-1]);
+        if (fault)
+          goto handle_fault;
+        break;
+      }
 
-  // Execute "CHAR"
-  else if (command_compare(kwd_char, index)) {
-    return handle_char(index);
-  }
+      case ET_ADD:
+        depth--;
+        #if EXPR_CHECKED == 1
+        if (expr_overflow(ET_ADD, top[-2], top[-1], &top[-2]))
+          goto handle_overflow;
+        #else
+        top[-2] = (var_t)((uvar_t)top[-2] + (uvar_t)top[-1]);
+        #endif
+        break;
 
-  // Execute "GOTO"
-  else if (command_compare(kwd_goto, index)) {
-    return handle_goto(index);
-  }
+      case ET_SUBTRACT:
+        depth--;
+        #if EXPR_CHECKED == 1
+        if (expr_overflow(ET_SUBTRACT, top[-2], top[-1], &top[-2]))
+          goto handle_overflow;
+        #else
+        top[-2] = (var_t)((uvar_t)top[-2] - (uvar_t)top[-1]);
+        #endif
+        break;
 
-  // Execute "IF"
-  else if (command_compare(kwd_if, index)) {
-    return handle_if(index);
-  }
+      case ET_AND:
+        depth--;
+        top[-2] &= top[-1];
+        break;
 
-  #if POKE_PEEK == 1
-  // Execute "POKE"
-  else if (command_compare(kwd_poke, index)) {
-    return handle_poke(index, false);
-  }
+      case ET_OR:
+        depth--;
+        top[-2] |= top[-1];
+        break;
 
-  // Execute "PEEK"
-  else if (command_compare(kwd_peek, index)) {
-    return handle_peek(index, false);
+      case ET_XOR:
+        depth--;
+        top[-2] ^= top[-1];
+        break;
+    }
   }
 
-  // Execute "POKEB"
-  else if (command_compare(kwd_pokeb, index)) {
-    return handle_poke(index, true);
-  }
+  *error = 0;
+  return stack[0];
 
-  // Execute "PEEKB"
-  else if (command_compare(kwd_peekb, index)) {
-    return handle_peek(index, true);
-  }
+  #if EXPR_CHECKED == 1
+  handle_overflow:
+  fault = str_err_overflow;
   #endif
+  handle_fault:
+  print_error(tb, fault, index);
+  *error = 1;
+  return 0;
+}
 
-  // Execute "INPUT"
-  else if (command_compare(kwd_input, index)) {
-    handle_input(index);
+#if EXPR_CACHE_SIZE > 0
+/**
+ * Get the cache entry for the expression (might be holding a different one)
+ */
+ExprCache *expr_cache_find(Interpreter *tb, size_t index, size_t length)
+{
+  if (!tb->expr_cache_valid) {
+    for (size_t i = 0; i < EXPR_CACHE_SIZE; i++)
+      tb->expr_cache[i].length = 0;
+    tb->expr_cache_pool_end = 0;
+    tb->expr_cache_valid = true;
   }
+  return &tb->expr_cache[(index + length) % EXPR_CACHE_SIZE];
+}
 
-  // Execute "REM" (reminder/comment command)
-  else if (command_compare(kwd_rem, index)) {
-    (void)0;
+/**
+ * Store the compiled expression in the cache entry
+ */
+void expr_cache_store(Interpreter *tb, ExprCache *cache, size_t index, size_t length)
+{
+  // Start over if the pool is full
+  if (tb->expr_cache_pool_end + tb->expr_token_count > EXPR_CACHE_POOL) {
+    tb->expr_cache_valid = false;
+    return;
   }
 
-  // Execute "CLEAR"
-  else if (command_compare(kwd_clear, index)) {
-    print_string(str_screen_clear);
+  for (size_t i = 0; i < tb->expr_token_count; i++) {
+    tb->expr_cache_type[tb->expr_cache_pool_end + i] = tb->expr_tokens.type[i];
+    tb->expr_cache_value[tb->expr_cache_pool_end + i] = tb->expr_tokens.value[i];
   }
+  cache->index = index;
+  cache->length = length;
+  cache->start = tb->expr_cache_pool_end;
+  cache->count = tb->expr_token_count;
+  tb->expr_cache_pool_end += tb->expr_token_count;
+}
 
-  // Execute "END"
-  else if (command_compare(kwd_end, index)) {
-    return MAX_LINENUM;
-  }
+/**
+ * Drop all the compiled expressions (code memory has changed)
+ */
+void expr_cache_clear(Interpreter *tb)
+{
+  tb->expr_cache_valid = false;
+}
+#endif
 
-  // Execute "RUN"
-  else if (command_compare(kwd_run, index)) {
-    if (!current_line)
-      handle_run();
-    else
-      print_error(str_err_run_mode, index);
-  }
+#else
+/**
+ * Calculate expression precedence
+ */
+bool expr_calc_precedence(Interpreter *tb)
+{
+  int8_t base_precedence = 0;
+  for (size_t i = 0; i < tb->expr_token_count; i++) {
+    switch (tb->expr_tokens.type[i]) {
 
-  // Execute "LIST"
-  else if (command_compare(kwd_list, index)) {
-    if (!current_line)
-      handle_list();
-    else
-      print_error(str_err_run_mode, index);
-  }
+      case ET_AND:
+      case ET_OR:
+      case ET_XOR:
+        tb->expr_tokens.precedence[i] = base_precedence + 1;
+        break;
 
-  // Execute "NEW"
-  else if (command_compare(kwd_new, index)) {
-    if (!current_line)
-      handle_new();
-    else
-      print_error(str_err_run_mode, index);
-  }
+      case ET_ADD:
+      case ET_SUBTRACT:
+        tb->expr_tokens.precedence[i] = base_precedence + 2;
+        break;
 
-  // Execute "MEMORY"
-  else if (command_compare(kwd_memory, index)) {
-    if (!current_line) {
-      print_signed((int)(CODE_MEMORY_SIZE - codemem_end));
-      print_string(str_memory_free);
-      print_string(str_lf);
-    } else {
-      print_error(str_err_run_mode, index);
-    }
-  }
+      case ET_MULTIPLY:
+      case ET_DIVIDE:
+      case ET_REMAINDER:
+        tb->expr_tokens.precedence[i] = base_precedence + 3;
+        break;
 
-  #if FILE_IO == 1
-  // Execute "SAVE"
-  else if (command_compare(kwd_save, index)) {
-    if (!current_line) {
-      handle_save(index);
-    } else {
-      print_error(str_err_run_mode, index);
-    }
-  }
+      case ET_SUBEXPR_OPEN:
+        base_precedence += ET_SUBEXPR;
+        break;
 
-  // Execute "LOAD"
-  else if (command_compare(kwd_load, index)) {
-    if (!current_line) {
-      handle_load(index);
-    } else {
-      print_error(str_err_run_mode, index);
+      case ET_SUBEXPR_CLOSE:
+        base_precedence -= ET_SUBEXPR;
+        break;
     }
-  }
-  #endif
 
-  // If command wasn't recognized show an error and return
-  else {
-    return print_error(str_err_unknown, index);
+    if (base_precedence < 0)
+      return 1;
   }
 
-  return (error) ? MAX_LINENUM : 0;
+  return !!base_precedence;
 }
 
 /**
- * Print the string, or strings if separated by ':'
+ * Filter the brackets from the expression
  */
-line_t handle_print(size_t index)
+void expr_filter_brackets(Interpreter *tb)
 {
-  const size_t initial_index = index;
-  index += strlen(kwd_print);
-  bool linefeed = true;
+  size_t index = 0, newindex = 0;
+  for (; index < tb->expr_token_count; index++) {
+    const uint8_t type = tb->expr_tokens.type[index];
+    if (type != ET_SUBEXPR_OPEN && type != ET_SUBEXPR_CLOSE) {
+      tb->expr_tokens.type[newindex] = type;
+      tb->expr_tokens.precedence[newindex] = tb->expr_tokens.precedence[index];
+      tb->expr_tokens.value[newindex++] = tb->expr_tokens.value[index];
+    }
+  }
+  tb->expr_token_count = newindex;
+}
 
-  while (1) {
+/**
+ * Try to solve highest precedence operation, return the error if it can't be done
+ */
+const char *expr_reduce(Interpreter *tb)
+{
+  // Find most important operation index
+  uint8_t prec = 0;
+  size_t index = 0;
+  for (size_t i = 0; i < tb->expr_token_count; i++) {
+    if (tb->expr_tokens.precedence[i] > prec) {
+      prec = tb->expr_tokens.precedence[i];
+      index = i;
+    }
+  }
 
-    // Disable linefeed if the line ended with the concat operator
-    if (codemem[index] == '\0') {
-      linefeed = false;
+  // Return the error if no operation can be performed
+  if (!prec || expr_reduce_check(tb, index))
+    return str_err_expression;
+
+  // Do the operation on the neighbouring values
+  const uint8_t type = tb->expr_tokens.type[index];
+  var_t *left = &tb->expr_tokens.value[index - 1];
+  const var_t right = tb->expr_tokens.value[index + 1];
+  switch (type) {
+    case ET_DIVIDE:
+    case ET_REMAINDER: {
+      const char *fault = expr_divide(type, left, right);
+      if (fault)
+        return fault;
       break;
     }
 
-    skip_spaces(&index);
-
-    // Handle string or the expression
-    if (codemem[index] == '"') {
-
-      // Get the string length
-      size_t len;
-      for (len = 0; codemem[index + len + 1] != '"'; len++)
-        if (codemem[index + len + 1] == '\0')
-          return print_error(str_err_string, initial_index);
+    case ET_MULTIPLY:
+    case ET_ADD:
+    case ET_SUBTRACT:
+      #if EXPR_CHECKED == 1
+      if (expr_overflow(type, *left, right, left))
+        return str_err_overflow;
+      #else
+      if (type == ET_MULTIPLY)
+        *left = (var_t)((uvar_t)*left * (uvar_t)right);
+      else if (type == ET_ADD)
+        *left = (var_t)((uvar_t)*left + (uvar_t)right);
+      else
+        *left = (var_t)((uvar_t)*left - (uvar_t)right);
+      #endif
+      break;
 
-      // Print the string
-      for (size_t i = 1; i <= len; i++)
-        PUTCHAR(&codemem[index + i]);
+    case ET_AND:
+      *left &= right;
+      break;
 
-      // Move the index
-      index += len + 2;
-      skip_spaces(&index);
+    case ET_OR:
+      *left |= right;
+      break;
 
-      // Continue while there are more expressions or strings
-      if (codemem[index] == ':') {
-        index++;
-      } else {
-        break;
-      }
-    } else {
+    case ET_XOR:
+      *left ^= right;
+      break;
 
-      // Get the expression length
-      size_t length = 0;
-      while (codemem[index + length] != '\0' && codemem[index + length] != ':')
-        length++;
+    default:
+      return str_err_expression;
+  }
 
-      // Get the expression value and print it out
-      bool error;
-      const var_t expr_value = expr_solve(index, length, &error);
-      if (error)
-        return MAX_LINENUM;
+  expr_erase(tb, index, 2);
+  return NULL;
+}
 
-      // Print the expression result
-      // NOLINTNEXTLINE
-      print_signed(expr_value);
+/**
+ * Reduce the unary operators
+ */
+bool expr_reduce_unary(Interpreter *tb)
+{
+  for (size_t i = tb->expr_token_count; i > 0; i--)
+  {
+    if (tb->expr_tokens.type[i] == ET_SUBEXPR_OPEN)
+      continue;
+    if (i > 1 && tb->expr_tokens.type[i - 2] == ET_VALUE)
+      continue;
+    if (i > 1 && tb->expr_tokens.type[i - 2] == ET_SUBEXPR_CLOSE)
+      continue;
 
-      // Continue while there are more expressions or strings
-      index += length;
-      if (codemem[index] == ':') {
-        index++;
-      } else {
-        break;
-      }
+    if (tb->expr_tokens.type[i - 1] == ET_ADD) {
+      if (tb->expr_tokens.type[i] != ET_VALUE)
+        return 1;
+      expr_erase(tb, i - 1, 1);
+    } else if (tb->expr_tokens.type[i - 1] == ET_SUBTRACT) {
+      if (tb->expr_tokens.type[i] != ET_VALUE)
+        return 1;
+      #if EXPR_CHECKED == 1
+      if (tb->expr_tokens.value[i] == VAR_MIN)
+        return 1;
+      #endif
+      tb->expr_tokens.value[i] = (var_t)(0 - (uvar_t)tb->expr_tokens.value[i]);
+      expr_erase(tb, i - 1, 1);
+    } else if (tb->expr_tokens.type[i - 1] == ET_INVERT) {
+      if (tb->expr_tokens.type[i] != ET_VALUE)
+        return 1;
+      tb->expr_tokens.value[i] = ~tb->expr_tokens.value[i];
+      expr_erase(tb, i - 1, 1);
     }
   }
 
-  // Show an error if there's something after the string
-  if (codemem[index] != '\0')
-    return print_error(str_err_str_garbage, initial_index);
-
-  // Print the LF and return
-  if (linefeed)
-    print_string(str_lf);
   return 0;
 }
 
 /**
- * Print a single character from a given variable
+ * Check if the operation is valid
  */
-line_t handle_char(size_t index)
+bool expr_reduce_check(Interpreter *tb, size_t index)
 {
-  const size_t initial_index = index;
-
-  // Get to the target variable
-  index += strlen(kwd_char);
-  skip_spaces(&index);
+  if (index == 0 || index == tb->expr_token_count)
+    return 1;
 
-  // Check the variable sanity
-  if (!isalpha(codemem[index]))
-    return print_error(str_err_char_variable, initial_index);
+  if (tb->expr_tokens.type[index - 1] != ET_VALUE)
+    return 1;
 
-  // Check for the garbage after variable
-  if (codemem[index + 1] != '\0')
-    return print_error(str_err_char_garbage, initial_index);
+  if (tb->expr_tokens.type[index + 1] != ET_VALUE)
+    return 1;
 
-  // Print the character
-  char chr = (char)variables[toupper(codemem[index]) - 'A'];
-  PUTCHAR(&chr);
   return 0;
 }
 
 /**
- * Handle let command, solve the expression and do the assignment
+ * Erase length tokens at index
  */
-line_t handle_let(size_t index)
+void expr_erase(Interpreter *tb, size_t index, size_t length)
 {
-  const size_t initial_index = index;
-
-  // Get the target variable
-  skip_spaces(&index);
-  if (!isalpha(codemem[index]))
-    return print_error(str_err_let_target, initial_index);
-  const size_t variable = toupper(codemem[index]) - 'A';
-
-  // Check for the equal symbol sanity
-  index++;
-  skip_spaces(&index);
-  if (codemem[index] != '=')
-    return print_error(str_err_let_sanity, initial_index);
+  const size_t count = (index + length < tb->expr_token_count) ? tb->expr_token_count - length - index : 0;
+  memmove(&tb->expr_tokens.value[index], &tb->expr_tokens.value[index + length], count * sizeof(var_t));
+  memmove(&tb->expr_tokens.type[index], &tb->expr_tokens.type[index + length], count);
+  memmove(&tb->expr_tokens.precedence[index], &tb->expr_tokens.precedence[index + length], count);
+  tb->expr_token_count -= length;
+}
 
-  // Get the expression length
-  index++;
-  size_t length = 0;
-  while (codemem[index + length] != '\0')
-    length++;
+#endif
 
-  // Solve the expression and assign the value
-  bool error;
-  const var_t expr_value = expr_solve(index, length, &error);
-  if (error)
-    return MAX_LINENUM;
-  variables[variable] = expr_value;
-  return 0;
-}
+/****************************************************************************/
 
 /**
- * List lines, their numbers and indices
+ * Compare the word in memory to the given command
  */
-void handle_list(void)
+bool command_compare(Interpreter *tb, const char *command, size_t index, size_t length)
 {
-  size_t index = 0;
-  while (index < codemem_end) {
-    const line_t linenum = load_line_t(index);
-    const size_t linelen = strlen(&codemem[index + sizeof(line_t)]);
-    #if LIST_DEBUG == 1
-      printf("index: %zu, linelen: %zu, linenum: %d # %s\n",
-        index, linelen, linenum, &codemem[index + sizeof(line_t)]);
-    #else
-      print_unsigned(linenum);
-      print_string(str_space);
-      print_string(&codemem[index + sizeof(line_t)]);
-      print_string(str_lf);
-    #endif
-    index += linelen + sizeof(line_t) + 1;
-  }
+  size_t i;
+  for (i = 0; command[i] && i < length; i++)
+    if (command[i] != toupper(tb->codemem[index + i]))
+      return false;
+  return (command[i] == '\0' && i == length);
 }
 
 /**
- * Get the GOTO target line
+ * Show the error
  */
-line_t handle_goto(size_t index)
+line_t print_error(Interpreter *tb, const char *error, size_t index)
 {
-  const size_t initial_index = index;
-  bool error;
-  index += strlen(kwd_goto);
-  skip_spaces(&index);
-  const line_t linenum = get_literal_number(index, &error);
-  if (linenum <= 0 || linenum >= MAX_LINENUM || error)
-    return print_error(str_err_goto_target, initial_index);
-  return linenum;
+  BENCH_COUNT(errors);
+  tb->error_reported = true;
+  if (tb->current_line) {
+    print_string(tb, str_err_at_line1);
+    print_unsigned(tb, tb->current_line);
+    print_string(tb, str_err_at_line2);
+    print_string(tb, error);
+    print_string(tb, str_lf);
+    print_unsigned(tb, tb->current_line);
+    print_string(tb, str_space);
+    print_code(tb, index);
+    print_string(tb, str_lf);
+  } else {
+    print_string(tb, str_err);
+    print_string(tb, error);
+    print_string(tb, str_lf);
+    print_code(tb, index);
+    print_string(tb, str_lf);
+  }
+  return MAX_LINENUM;
 }
 
 /**
- * Check the condition and execute the command if it's met
+ * Detect the command and call the appropriate method on it and return next line address
  */
-line_t handle_if(size_t index)
+line_t execute_command(Interpreter *tb, size_t index)
 {
-  const size_t initial_index = index;
-  bool error;
-  index += strlen(kwd_if);
-  skip_spaces(&index);
+  bool error = false;
 
-  // Do the first expression
-  size_t length = 0;
-  while (1) {
-    const char chr = codemem[index + length];
-    if (chr == '<' || chr == '>' || chr == '=' || chr == '\0')
-      break;
-    length++;
-  }
-  if (codemem[index + length] == '\0')
-    return print_error(str_err_if_exprs, initial_index);
-  var_t expr_left_value = expr_solve(index, length, &error);
-  if (error)
-    return MAX_LINENUM;
+  switch ((uint8_t)tb->codemem[index]) {
 
-  // Check what operation needs to be done
-  uint8_t compare_operation;
-  index += length;
-  if (codemem[index] == '<') {
-    if (codemem[index + 1] == '>') {
-      compare_operation = CO_NOT_EQUAL;
-      index += 2;
-    } else {
-      compare_operation = CO_LOWER;
-      index++;
-    }
-  } else if (codemem[index] == '>') {
-    compare_operation = CO_GREATER;
-    index++;
-  } else if (codemem[index] == '=') {
-    compare_operation = CO_EQUAL;
-    index++;
-  } else {
-    return print_error(str_err_if_compare, initial_index);
-  }
+    // Execute "LET"
+    case TK_LET:
+      return handle_let(tb, index + 1);
 
-  // Get the second expression
-  length = 0;
-  while (1) {
-    if (codemem[index + length] == '\0')
-      return print_error(str_err_if_then, initial_index);
-    if (command_compare(kwd_then, index + length))
-      break;
-    length++;
-  }
-  var_t expr_right_value = expr_solve(index, length, &error);
-  if (error)
-    return MAX_LINENUM;
+    // Execute "PRINT"
+    case TK_PRINT:
+      return handle_print(tb, index);
 
-  // Check the condition
-  bool condition = false;
-  switch (compare_operation) {
-    case CO_EQUAL:
-      condition = (expr_left_value == expr_right_value);
-      break;
-    case CO_NOT_EQUAL:
-      condition = (expr_left_value != expr_right_value);
+    // Execute "CHAR"
+    case TK_CHAR:
+      return handle_char(tb, index);
+
+    // Execute "GOTO"
+    case TK_GOTO:
+      return handle_goto(tb, index);
+
+    // Execute "IF"
+    case TK_IF:
+      return handle_if(tb, index);
+
+    #if POKE_PEEK == 1
+    // Execute "POKE"
+    case TK_POKE:
+      return handle_poke(tb, index, false);
+
+    // Execute "PEEK"
+    case TK_PEEK:
+      return handle_peek(tb, index, false);
+
+    // Execute "POKEB"
+    case TK_POKEB:
+      return handle_poke(tb, index, true);
+
+    // Execute "PEEKB"
+    case TK_PEEKB:
+      return handle_peek(tb, index, true);
+    #endif
+
+    // Execute "INPUT"
+    case TK_INPUT:
+      return handle_input(tb, index);
+
+    #if CONTROL_STACK_SIZE > 0
+    // Execute "FOR", "NEXT", "GOSUB" and "RETURN"
+    case TK_FOR:
+    case TK_NEXT:
+    case TK_GOSUB:
+    case TK_RETURN:
+      return handle_control(tb, index);
+    #endif
+
+    #if ARRAYS == 1
+    // Execute "DIM"
+    case TK_DIM:
+      return handle_dim(tb, index);
+    #endif
+
+    // Execute "REM" (reminder/comment command)
+    case TK_REM:
       break;
-    case CO_LOWER:
-      condition = (expr_left_value  < expr_right_value);
+
+    // Execute "CLEAR"
+    case TK_CLEAR:
+      print_string(tb, str_screen_clear);
       break;
-    case CO_GREATER:
-      condition = (expr_left_value  > expr_right_value);
+
+    // Execute "END"
+    case TK_END:
+      return MAX_LINENUM;
+
+    // Execute "RUN"
+    case TK_RUN:
+      if (tb->current_line)
+        print_error(tb, str_err_run_mode, index);
+      #if STEP_API == 1
+      // Under tb_step() the program runs by the slices
+      else if (tb->step_state == STEP_LINE)
+        tb->step_state = (run_start(tb)) ? STEP_LINE : STEP_RUN;
+      #endif
+      else
+        handle_run(tb);
+      break;
+
+    // Execute "LIST"
+    case TK_LIST:
+      if (!tb->current_line)
+        handle_list(tb);
+      else
+        print_error(tb, str_err_run_mode, index);
+      break;
+
+    // Execute "NEW"
+    case TK_NEW:
+      if (!tb->current_line)
+        handle_new(tb);
+      else
+        print_error(tb, str_err_run_mode, index);
+      break;
+
+    // Execute "MEMORY"
+    case TK_MEMORY:
+      if (!tb->current_line) {
+        print_signed(tb, (int)(codemem_free_end(tb) - tb->codemem_end));
+        print_string(tb, str_memory_free);
+        print_string(tb, str_lf);
+      } else {
+        print_error(tb, str_err_run_mode, index);
+      }
+      break;
+
+    #if PROFILE == 1
+    // Execute "PROFILE"
+    case TK_PROFILE:
+      if (!tb->current_line)
+        handle_profile(tb);
+      else
+        print_error(tb, str_err_run_mode, index);
+      break;
+    #endif
+
+    #if STATS == 1
+    // Execute "STATS"
+    case TK_STATS:
+      handle_stats(tb);
+      break;
+    #endif
+
+    #if FILE_IO == 1
+    // Execute "SAVE"
+    case TK_SAVE:
+      if (!tb->current_line) {
+        handle_save(tb, index, false);
+      } else {
+        print_error(tb, str_err_run_mode, index);
+      }
+      break;
+
+    // Execute "BSAVE"
+    case TK_BSAVE:
+      if (!tb->current_line) {
+        handle_save(tb, index, true);
+      } else {
+        print_error(tb, str_err_run_mode, index);
+      }
+      break;
+
+    // Execute "LOAD"
+    case TK_LOAD:
+      if (!tb->current_line) {
+        handle_load(tb, index);
+      } else {
+        print_error(tb, str_err_run_mode, index);
+      }
       break;
+    #endif
+
+    default:
+      // Execute "LET" without the keyword
+      if (isalpha(tb->codemem[index]) && (tb->codemem[index + 1] == ' ' || tb->codemem[index + 1] == '=' ||
+          (ARRAYS == 1 && tb->codemem[index + 1] == '(')))
+        return handle_let(tb, index);
+
+      // If command wasn't recognized show an error and return
+      return print_error(tb, str_err_unknown, index);
+  }
+
+  return (error) ? MAX_LINENUM : 0;
+}
+
+/**
+ * Get the statement cache slot for the index (or the local one if it can't be cached)
+ */
+Statement *stmt_slot(Interpreter *tb, size_t index, Statement *local)
+{
+  local->command = 0;
+  #if STMT_CACHE_SIZE > 0
+  if (index < tb->codemem_end) {
+    if (!tb->stmt_cache_valid) {
+      for (size_t i = 0; i < STMT_CACHE_SIZE; i++)
+        tb->stmt_cache[i].command = 0;
+      tb->stmt_cache_valid = true;
+    }
+    return &tb->stmt_cache[index % STMT_CACHE_SIZE];
+  }
+  #else
+  (void)tb;
+  (void)index;
+  #endif
+  return local;
+}
+
+/**
+ * Check if the slot holds the decoded statement from the index
+ */
+static inline bool stmt_decoded(const Statement *stmt, size_t index)
+{
+  return stmt->command && stmt->index == index;
+}
+
+/**
+ * Drop all the decoded statements and the program check (code memory has changed)
+ */
+void stmt_cache_clear(Interpreter *tb)
+{
+  #if STMT_CACHE_SIZE > 0
+  tb->stmt_cache_valid = false;
+  #endif
+  #if RUN_ANALYZER == 1
+  tb->program_checked = false;
+  #endif
+  #if STMT_CACHE_SIZE == 0 && RUN_ANALYZER == 0
+  (void)tb;
+  #endif
+}
+
+#if STMT_FUSION == 1
+/**
+ * Find if the expression is a variable, a number or the target variable with a number added, which aren't solved
+ */
+uint8_t decode_operand(Interpreter *tb, size_t index, size_t length, uint8_t target, var_t *value)
+{
+  size_t end = index + length;
+  while (index < end && isblank(tb->codemem[index]))
+    index++;
+  while (end > index && isblank(tb->codemem[end - 1]))
+    end--;
+  if (index == end)
+    return FO_EXPRESSION;
+
+  // The variable alone, or the target variable followed by the number added or subtracted
+  uint8_t kind = FO_CONSTANT;
+  bool negative = false;
+  if (isalpha(tb->codemem[index])) {
+    const uint8_t variable = toupper(tb->codemem[index++]) - 'A';
+    if (index == end) {
+      *value = variable;
+      return FO_VARIABLE;
+    }
+    skip_spaces(tb, &index);
+    if (variable != target || (tb->codemem[index] != '+' && tb->codemem[index] != '-'))
+      return FO_EXPRESSION;
+    kind = FO_INCREMENT;
+    negative = tb->codemem[index++] == '-';
+    skip_spaces(tb, &index);
+  } else if (tb->codemem[index] == '-') {
+    negative = true;
+    index++;
+    skip_spaces(tb, &index);
+  }
+
+  // The number has to take the rest of the expression (the minimum value can't be negated)
+  if (index >= end || (!is_number_token(tb->codemem[index]) && !isdigit(tb->codemem[index])))
+    return FO_EXPRESSION;
+  bool error;
+  const var_t number = get_number(tb, &index, &error);
+  if (error || index != end || number == VAR_MIN)
+    return FO_EXPRESSION;
+  *value = (negative) ? -number : number;
+  return kind;
+}
+
+/**
+ * Resolve the 'GOTO' after 'THEN' to its line, NO_JUMP if it's another command or the line doesn't exist
+ */
+size_t decode_branch(Interpreter *tb, size_t index, line_t *target)
+{
+  if ((uint8_t)tb->codemem[index] != TK_GOTO)
+    return NO_JUMP;
+  bool error;
+  index++;
+  skip_spaces(tb, &index);
+  const line_t linenum = get_number(tb, &index, &error);
+  if (linenum <= 0 || linenum >= MAX_LINENUM || error)
+    return NO_JUMP;
+  *target = linenum;
+
+  #if LINE_INDEX == 1
+  const size_t slot = line_index_find(tb, linenum);
+  return (slot < tb->line_count && tb->line_index[slot].linenum == linenum) ? slot : NO_JUMP;
+  #else
+  const size_t line = get_line_index(tb, linenum);
+  return (line < tb->codemem_end) ? line : NO_JUMP;
+  #endif
+}
+#endif
+
+/**
+ * Get the value of the statement expression, the fused ones are taken without solving it
+ */
+static inline var_t stmt_value(Interpreter *tb, const Statement *stmt, size_t i, bool *error)
+{
+  #if STMT_FUSION == 1
+  switch (stmt->operand[i]) {
+    case FO_VARIABLE:
+      STATS_ADD(ST_FUSED, 1);
+      *error = false;
+      return tb->variables[stmt->value[i]];
+
+    case FO_CONSTANT:
+      STATS_ADD(ST_FUSED, 1);
+      *error = false;
+      return stmt->value[i];
+
+    case FO_INCREMENT: {
+      STATS_ADD(ST_FUSED, 1);
+      #if EXPR_CHECKED == 1
+      var_t result = 0;
+      *error = expr_overflow(ET_ADD, tb->variables[stmt->variable], stmt->value[i], &result);
+      if (*error)
+        print_error(tb, str_err_overflow, stmt->expr_index[i]);
+      return result;
+      #else
+      *error = false;
+      return (var_t)((uvar_t)tb->variables[stmt->variable] + (uvar_t)stmt->value[i]);
+      #endif
+    }
+  }
+  #endif
+  return expr_solve(tb, stmt->expr_index[i], stmt->expr_length[i], error);
+}
+
+/**
+ * Decode a part of print statement starting at the index (after 'PRINT' or ':')
+ */
+bool decode_print(Interpreter *tb, size_t index, size_t initial_index, Statement *stmt)
+{
+  STATS_ADD(ST_STMT_DECODES, 1);
+  stmt->command = 0;
+  const size_t part_index = index;
+
+  // Disable linefeed if the line ended with the concat operator
+  if (tb->codemem[index] == '\0') {
+    stmt->command = PP_NONE;
+    stmt->compare = PE_NO_LINEFEED;
+    stmt->index = part_index;
+    return false;
+  }
+
+  skip_spaces(tb, &index);
+
+  // Get the number format
+  stmt->variable = 0;
+  #if PRINT_FORMAT == 1
+  if ((uint8_t)tb->codemem[index] == TK_HEX || (uint8_t)tb->codemem[index] == TK_BIN) {
+    stmt->variable = (uint8_t)tb->codemem[index] == TK_HEX ? TK_NUMBER_HEX : TK_NUMBER_BIN;
+    index++;
+    skip_spaces(tb, &index);
+  }
+  #endif
+
+  // Handle string or the expression
+  if (tb->codemem[index] == '"' && !stmt->variable) {
+
+    // Get the string length
+    size_t len;
+    for (len = 0; tb->codemem[index + len + 1] != '"'; len++)
+      if (tb->codemem[index + len + 1] == '\0') {
+        print_error(tb, str_err_string, initial_index);
+        return true;
+      }
+    stmt->command = PP_STRING;
+    stmt->expr_index[0] = index + 1;
+    stmt->expr_length[0] = len;
+
+    // Move the index
+    index += len + 2;
+    skip_spaces(tb, &index);
+  } else {
+
+    // Get the expression length
+    size_t length = 0;
+    while (tb->codemem[index + length] != '\0' && tb->codemem[index + length] != ':')
+      length++;
+    stmt->command = PP_EXPRESSION;
+    stmt->expr_index[0] = index;
+    stmt->expr_length[0] = length;
+    index += length;
   }
 
-  // Do the next line if condition met
-  if (condition) {
-    index += length + strlen(kwd_then);
-    skip_spaces(&index);
-    return execute_command(index);
+  // Continue while there are more expressions or strings
+  if (tb->codemem[index] == ':') {
+    stmt->compare = PE_CONTINUE;
+    stmt->next = index + 1;
+  } else if (tb->codemem[index] != '\0') {
+    stmt->compare = PE_GARBAGE;
   } else {
-    return 0;
+    stmt->compare = PE_LINEFEED;
   }
+
+  stmt->index = part_index;
+  return false;
 }
 
 /**
- * Handle the input command
+ * Print the string, or strings if separated by ':'
+ */
+line_t handle_print(Interpreter *tb, size_t index)
+{
+  const size_t initial_index = index;
+  index++;
+
+  while (1) {
+
+    // Get the decoded part
+    Statement local;
+    Statement *stmt = stmt_slot(tb, index, &local);
+    if (!stmt_decoded(stmt, index) && decode_print(tb, index, initial_index, stmt))
+      return MAX_LINENUM;
+
+    // Print the string
+    if (stmt->command == PP_STRING) {
+      for (size_t i = 0; i < stmt->expr_length[0]; i++)
+        OUTPUT(&tb->codemem[stmt->expr_index[0] + i]);
+    }
+
+    // Get the expression value and print it out
+    else if (stmt->command == PP_EXPRESSION) {
+      bool error;
+      const var_t expr_value = expr_solve(tb, stmt->expr_index[0], stmt->expr_length[0], &error);
+      if (error)
+        return MAX_LINENUM;
+
+      #if PRINT_FORMAT == 1
+      // Print in the hex or binary literal format if requested
+      if (stmt->variable) {
+        char buffer[NUMBER_BUFFER_SIZE];
+        format_number((uvar_t)expr_value, stmt->variable, buffer);
+        print_string(tb, buffer);
+      } else {
+        print_signed(tb, expr_value);
+      }
+      #else
+      // NOLINTNEXTLINE
+      print_signed(tb, expr_value);
+      #endif
+    }
+
+    // Continue while there are more expressions or strings
+    switch (stmt->compare) {
+      case PE_CONTINUE:
+        index = stmt->next;
+        break;
+
+      // Show an error if there's something after the string
+      case PE_GARBAGE:
+        return print_error(tb, str_err_str_garbage, initial_index);
+
+      // Print the LF and return
+      case PE_LINEFEED:
+        print_string(tb, str_lf);
+        return 0;
+
+      case PE_NO_LINEFEED:
+        return 0;
+    }
+  }
+}
+
+/**
+ * Print a single character from a given variable
+ */
+line_t handle_char(Interpreter *tb, size_t index)
+{
+  const size_t initial_index = index;
+
+  // Get to the target variable
+  index++;
+  skip_spaces(tb, &index);
+
+  // Check the variable sanity
+  if (!isalpha(tb->codemem[index]))
+    return print_error(tb, str_err_char_variable, initial_index);
+
+  // Check for the garbage after variable
+  if (tb->codemem[index + 1] != '\0')
+    return print_error(tb, str_err_char_garbage, initial_index);
+
+  // Print the character
+  char chr = (char)tb->variables[toupper(tb->codemem[index]) - 'A'];
+  OUTPUT(&chr);
+  return 0;
+}
+
+/**
+ * Decode the let command, get the target variable and the expression
  */
-line_t handle_input(size_t index)
+bool decode_let(Interpreter *tb, size_t index, Statement *stmt)
 {
+  STATS_ADD(ST_STMT_DECODES, 1);
+  stmt->command = 0;
   const size_t initial_index = index;
 
   // Get the target variable
-  index += strlen(kwd_input);
-  while (isblank(codemem[index]))
+  skip_spaces(tb, &index);
+  if (!isalpha(tb->codemem[index])) {
+    print_error(tb, str_err_let_target, initial_index);
+    return true;
+  }
+  stmt->variable = toupper(tb->codemem[index]) - 'A';
+
+  // Get the index of the array element in brackets
+  index++;
+  skip_spaces(tb, &index);
+  #if ARRAYS == 1
+  if (tb->codemem[index] == '(') {
+    const size_t start = ++index;
+    size_t depth = 1;
+    for (; tb->codemem[index] != '\0'; index++) {
+      if (tb->codemem[index] == '(')
+        depth++;
+      else if (tb->codemem[index] == ')' && !--depth)
+        break;
+    }
+    if (depth) {
+      print_error(tb, str_err_let_target, initial_index);
+      return true;
+    }
+    stmt->variable |= VARIABLE_ARRAY;
+    stmt->expr_index[1] = start;
+    stmt->expr_length[1] = index - start;
     index++;
+    skip_spaces(tb, &index);
+  }
+  #endif
 
-  if (codemem[index] == '\0')
-    return print_error(str_err_input_target, initial_index);
-  if (!isalpha(codemem[index]) || codemem[index + 1] != '\0')
-    return print_error(str_err_input_target, initial_index);
+  // Check for the equal symbol sanity
+  if (tb->codemem[index] != '=') {
+    print_error(tb, str_err_let_sanity, initial_index);
+    return true;
+  }
 
-  const size_t variable = toupper(codemem[index]) - 'A';
+  // Get the expression length
+  index++;
+  size_t length = 0;
+  while (tb->codemem[index + length] != '\0')
+    length++;
+  stmt->expr_index[0] = index;
+  stmt->expr_length[0] = length;
+  #if STMT_FUSION == 1
+  stmt->operand[0] = decode_operand(tb, index, length, stmt->variable, &stmt->value[0]);
+  #endif
 
-  // Get and exaluate the expression
-  size_t expr_length = 0;
-  while (1) {
-    char chr;
-    GETCHAR(&chr);
+  stmt->command = TK_LET;
+  stmt->index = initial_index;
+  return false;
+}
+
+/**
+ * Handle let command, solve the expression and do the assignment
+ */
+line_t handle_let(Interpreter *tb, size_t index)
+{
+  Statement local;
+  Statement *stmt = stmt_slot(tb, index, &local);
+  if (!stmt_decoded(stmt, index) && decode_let(tb, index, stmt))
+    return MAX_LINENUM;
+
+  // Solve the expression and assign the value
+  bool error;
+  const var_t expr_value = stmt_value(tb, stmt, 0, &error);
+  if (error)
+    return MAX_LINENUM;
+  #if ARRAYS == 1
+  if (stmt->variable & VARIABLE_ARRAY)
+    return (array_assign(tb, stmt, expr_value)) ? MAX_LINENUM : 0;
+  #endif
+  tb->variables[stmt->variable] = expr_value;
+  return 0;
+}
+
+/**
+ * List lines, their numbers and indices
+ */
+void handle_list(Interpreter *tb)
+{
+  size_t index = 0;
+  while (index < tb->codemem_end) {
+    const line_t linenum = load_line_t(tb, index);
+    const size_t linelen = strlen(&tb->codemem[index + sizeof(line_t)]);
+    #if LIST_DEBUG == 1
+      printf("index: %zu, linelen: %zu, linenum: %d # %s\n",
+        index, linelen, linenum, &tb->codemem[index + sizeof(line_t)]);
+    #else
+      print_unsigned(tb, linenum);
+      print_string(tb, str_space);
+      print_code(tb, index + sizeof(line_t));
+      print_string(tb, str_lf);
+    #endif
+    index += linelen + sizeof(line_t) + 1;
+  }
+}
+
+#if PROFILE == 1
+/**
+ * Check if the line from slot_a goes before the one from slot_b in the profile
+ */
+static inline bool profile_before(Interpreter *tb, size_t slot_a, size_t slot_b)
+{
+  const LineIndex *a = &tb->line_index[slot_a], *b = &tb->line_index[slot_b];
+  if (a->ticks != b->ticks)
+    return a->ticks > b->ticks;
+  if (a->hits != b->hits)
+    return a->hits > b->hits;
+  return slot_a < slot_b;
+}
+
+/**
+ * Count the line execution and the time it took since the ticks
+ */
+static inline void profile_line_end(LineIndex *line, unsigned long ticks)
+{
+  line->ticks += PROFILE_TICKS() - ticks;
+  line->hits++;
+}
+
+/**
+ * List the lines that took the most time during the last run
+ */
+void handle_profile(Interpreter *tb)
+{
+  size_t previous = tb->line_count;
+  for (size_t i = 0; i < PROFILE_TOP; i++) {
+
+    // Find the next line after the previously shown one
+    size_t slot = tb->line_count;
+    for (size_t j = 0; j < tb->line_count; j++) {
+      if (!tb->line_index[j].hits)
+        continue;
+      if (previous < tb->line_count && !profile_before(tb, previous, j))
+        continue;
+      if (slot == tb->line_count || profile_before(tb, j, slot))
+        slot = j;
+    }
+    if (slot == tb->line_count)
+      break;
+    previous = slot;
+
+    // Show the statistics with the line
+    print_unsigned(tb, tb->line_index[slot].hits);
+    print_string(tb, str_space);
+    print_unsigned(tb, tb->line_index[slot].ticks);
+    print_string(tb, str_space);
+    print_unsigned(tb, tb->line_index[slot].linenum);
+    print_string(tb, str_space);
+    print_code(tb, tb->line_index[slot].index + sizeof(line_t));
+    print_string(tb, str_lf);
+  }
+}
+#endif
+
+#if STATS == 1
+/**
+ * List the runtime counters with their names
+ */
+void handle_stats(Interpreter *tb)
+{
+  for (size_t i = 0; i < ST_COUNT; i++) {
+    print_string(tb, stats_names[i]);
+    print_string(tb, str_space);
+    print_unsigned(tb, tb->stats[i]);
+    print_string(tb, str_lf);
+  }
+}
+#endif
+
+/**
+ * Decode the GOTO target line
+ */
+bool decode_goto(Interpreter *tb, size_t index, Statement *stmt)
+{
+  STATS_ADD(ST_STMT_DECODES, 1);
+  stmt->command = 0;
+  const size_t initial_index = index;
+  bool error;
+  index++;
+  skip_spaces(tb, &index);
+  const line_t linenum = get_number(tb, &index, &error);
+  if (linenum <= 0 || linenum >= MAX_LINENUM || error) {
+    print_error(tb, str_err_goto_target, initial_index);
+    return true;
+  }
+
+  stmt->target = linenum;
+  stmt->command = TK_GOTO;
+  stmt->index = initial_index;
+  return false;
+}
+
+/**
+ * Get the GOTO target line
+ */
+line_t handle_goto(Interpreter *tb, size_t index)
+{
+  Statement local;
+  Statement *stmt = stmt_slot(tb, index, &local);
+  if (!stmt_decoded(stmt, index) && decode_goto(tb, index, stmt))
+    return MAX_LINENUM;
+  return stmt->target;
+}
+
+/**
+ * Decode the if command, find the expressions, compare operation and the command
+ */
+bool decode_if(Interpreter *tb, size_t index, Statement *stmt)
+{
+  STATS_ADD(ST_STMT_DECODES, 1);
+  stmt->command = 0;
+  const size_t initial_index = index;
+  index++;
+  skip_spaces(tb, &index);
+
+  // Do the first expression
+  size_t length = 0;
+  while (1) {
+    const char chr = tb->codemem[index + length];
+    if (chr == '<' || chr == '>' || chr == '=' || chr == '\0')
+      break;
+    length++;
+  }
+  if (tb->codemem[index + length] == '\0') {
+    print_error(tb, str_err_if_exprs, initial_index);
+    return true;
+  }
+  stmt->expr_index[0] = index;
+  stmt->expr_length[0] = length;
+
+  // Check what operation needs to be done
+  index += length;
+  if (tb->codemem[index] == '<') {
+    if (tb->codemem[index + 1] == '>') {
+      stmt->compare = CO_NOT_EQUAL;
+      index += 2;
+    } else {
+      stmt->compare = CO_LOWER;
+      index++;
+    }
+  } else if (tb->codemem[index] == '>') {
+    stmt->compare = CO_GREATER;
+    index++;
+  } else if (tb->codemem[index] == '=') {
+    stmt->compare = CO_EQUAL;
+    index++;
+  } else {
+    print_error(tb, str_err_if_compare, initial_index);
+    return true;
+  }
+
+  // Get the second expression
+  length = 0;
+  while (1) {
+    if (tb->codemem[index + length] == '\0') {
+      print_error(tb, str_err_if_then, initial_index);
+      return true;
+    }
+    if ((uint8_t)tb->codemem[index + length] == TK_THEN)
+      break;
+    length++;
+  }
+  stmt->expr_index[1] = index;
+  stmt->expr_length[1] = length;
+
+  // Get the command after 'THEN'
+  index += length + 1;
+  skip_spaces(tb, &index);
+  stmt->next = index;
+
+  // Variables and numbers are compared right away (there's no target to increment) and 'GOTO' is jumped to directly
+  #if STMT_FUSION == 1
+  for (size_t i = 0; i < 2; i++)
+    stmt->operand[i] = decode_operand(tb, stmt->expr_index[i], stmt->expr_length[i], UINT8_MAX, &stmt->value[i]);
+  stmt->jump = decode_branch(tb, index, &stmt->target);
+  #endif
+
+  stmt->command = TK_IF;
+  stmt->index = initial_index;
+  return false;
+}
+
+/**
+ * Compare the values with the compare operation
+ */
+static inline bool compare_values(uint8_t compare, var_t left, var_t right)
+{
+  switch (compare) {
+    case CO_EQUAL:
+      return left == right;
+    case CO_NOT_EQUAL:
+      return left != right;
+    case CO_LOWER:
+      return left < right;
+    case CO_GREATER:
+      return left > right;
+  }
+  return false;
+}
+
+/**
+ * Check the condition and execute the command if it's met
+ */
+line_t handle_if(Interpreter *tb, size_t index)
+{
+  Statement local;
+  Statement *stmt = stmt_slot(tb, index, &local);
+  if (!stmt_decoded(stmt, index) && decode_if(tb, index, stmt))
+    return MAX_LINENUM;
+
+  // Solve the expressions
+  bool error;
+  var_t expr_left_value = stmt_value(tb, stmt, 0, &error);
+  if (error)
+    return MAX_LINENUM;
+  var_t expr_right_value = stmt_value(tb, stmt, 1, &error);
+  if (error)
+    return MAX_LINENUM;
+
+  // Do the next line if condition met, the fused 'GOTO' goes to its line right away
+  if (compare_values(stmt->compare, expr_left_value, expr_right_value)) {
+    STATS_ADD(ST_STATEMENTS, 1);
+    #if STMT_FUSION == 1
+    if (stmt->jump != NO_JUMP) {
+      STATS_ADD(ST_FUSED, 1);
+      return stmt->target;
+    }
+    #endif
+    return execute_command(tb, stmt->next);
+  } else {
+    return 0;
+  }
+}
+
+/**
+ * Handle the input command
+ */
+line_t handle_input(Interpreter *tb, size_t index)
+{
+  const size_t initial_index = index;
+
+  // Get the target variable
+  index++;
+  while (isblank(tb->codemem[index]))
+    index++;
+
+  if (tb->codemem[index] == '\0')
+    return print_error(tb, str_err_input_target, initial_index);
+  if (!isalpha(tb->codemem[index]) || tb->codemem[index + 1] != '\0')
+    return print_error(tb, str_err_input_target, initial_index);
+
+  const size_t variable = toupper(tb->codemem[index]) - 'A';
+
+  // Get and exaluate the expression, it's kept after the shell line
+  size_t expr_end = tb->newline_end;
+  #if STEP_API == 1
+  // The program run by tb_step() waits for the value from tb_feed_char() and executes the line again
+  if (tb->step_state == STEP_RUN) {
+    tb->step_state = STEP_INPUT;
+    tb->input_length = 0;
+    return MAX_LINENUM;
+  }
+  if (tb->step_state == STEP_INPUT_DONE) {
+    tb->step_state = STEP_RUN;
+    expr_end += tb->input_length;
+  } else
+  #endif
+  {
+    #if INPUT_BUFFER_SIZE > 0
+    // Plain numbers are taken right from the input buffer, other values are solved from the code memory
+    const char *line = "";
+    size_t length = 0;
+    bool complete = true;
+    input_line(tb, &line, &length, &complete);
+    #if LOOPBACK == 0
+    var_t value;
+    if (complete && input_number(line, length, &value)) {
+      tb->variables[variable] = value;
+      return 0;
+    }
+    #endif
+    input_copy(tb, line, length, complete, tb->newline_end, &expr_end);
+    #else
+    char chr;
+    do {
+      INPUT_CHAR(&chr);
+    } while (!edit_line(tb, tb->newline_end, &expr_end, chr));
+    #endif
+  }
+  const size_t expr_length = expr_end - tb->newline_end;
+  tb->codemem[expr_end] = '\0';
+
+  bool error;
+  var_t expr_value = expr_solve(tb, tb->newline_end, expr_length, &error);
+  if (error)
+    return MAX_LINENUM;
+
+  tb->variables[variable] = expr_value;
+  return 0;
+}
+
+/**
+ * Edit the line typed from start to end with the received character, return true on the line feed
+ */
+bool edit_line(Interpreter *tb, size_t start, size_t *end, char chr)
+{
+  // If it was backspace delete the character from the line
+  if (chr == BACKSPACE) {
+    if (*end > start) {
+      (*end)--;
+      #if LOOPBACK == 1
+      print_string(tb, str_bs);
+      #endif
+    }
+    return false;
+  }
+
+  // If it was line feed the line is complete
+  else if (chr == NEWLINE) {
+    #if LOOPBACK == 1
+    print_string(tb, str_lf);
+    #endif
+    return true;
+  }
+
+  // If it wasn't line feed add the character to the memory, leave a byte for the terminator
+  else if (*end + 1 < codemem_free_end(tb)) {
+    tb->codemem[(*end)++] = chr;
+    #if LOOPBACK == 1
+    OUTPUT(&chr);
+    #endif
+  }
+
+  return false;
+}
+
+#if ARRAYS == 1
+/**
+ * Drop all the arrays
+ */
+void array_clear(Interpreter *tb)
+{
+  for (size_t i = 0; i < 26; i++)
+    tb->array_length[i] = 0;
+  tb->arena_start = CODE_MEMORY_SIZE;
+}
+
+/**
+ * Find the array element in codemem, return the error if it doesn't exist
+ */
+const char *array_find(Interpreter *tb, uint8_t variable, var_t element, size_t *offset)
+{
+  if (!tb->array_length[variable])
+    return str_err_array_dim;
+  if (element < 0 || (uvar_t)element >= tb->array_length[variable])
+    return str_err_array_index;
+  *offset = tb->array_start[variable] + (size_t)element * sizeof(var_t);
+  return NULL;
+}
+
+/**
+ * Load the array element (might be unaligned)
+ */
+static inline var_t array_load(Interpreter *tb, size_t offset)
+{
+  var_t value;
+  memcpy(&value, &tb->codemem[offset], sizeof(var_t));
+  return value;
+}
+
+/**
+ * Store the array element (might be unaligned)
+ */
+static inline void array_store(Interpreter *tb, size_t offset, var_t value)
+{
+  memcpy(&tb->codemem[offset], &value, sizeof(var_t));
+}
+
+/**
+ * Assign the value to the array element of the let statement, return true on error
+ */
+bool array_assign(Interpreter *tb, const Statement *stmt, var_t value)
+{
+  bool error;
+  const var_t element = expr_solve(tb, stmt->expr_index[1], stmt->expr_length[1], &error);
+  if (error)
+    return true;
+
+  size_t offset = 0;
+  const char *fault = array_find(tb, stmt->variable & ~VARIABLE_ARRAY, element, &offset);
+  if (fault) {
+    print_error(tb, fault, stmt->index);
+    return true;
+  }
+  array_store(tb, offset, value);
+  return false;
+}
+
+/**
+ * Handle the dim command, allocate the arrays from the end of the free memory
+ */
+line_t handle_dim(Interpreter *tb, size_t index)
+{
+  const size_t initial_index = index;
+  index++;
+
+  while (1) {
+
+    // Get the array variable and the bracket
+    skip_spaces(tb, &index);
+    if (!isalpha(tb->codemem[index]))
+      return print_error(tb, str_err_dim_target, initial_index);
+    const uint8_t variable = toupper(tb->codemem[index]) - 'A';
+    index++;
+    skip_spaces(tb, &index);
+    if (tb->codemem[index] != '(')
+      return print_error(tb, str_err_dim_target, initial_index);
+
+    // Find the matching bracket and solve the highest index
+    const size_t start = ++index;
+    size_t depth = 1;
+    for (; tb->codemem[index] != '\0'; index++) {
+      if (tb->codemem[index] == '(')
+        depth++;
+      else if (tb->codemem[index] == ')' && !--depth)
+        break;
+    }
+    if (depth)
+      return print_error(tb, str_err_dim_target, initial_index);
+
+    bool error;
+    const var_t last = expr_solve(tb, start, index - start, &error);
+    if (error)
+      return MAX_LINENUM;
+    if (last < 0)
+      return print_error(tb, str_err_array_index, initial_index);
+    if (tb->array_length[variable])
+      return print_error(tb, str_err_dim_twice, initial_index);
+
+    // Take the elements (0 to the highest index) from the end of the free memory, aligned for var_t
+    const size_t free_start = tb->newline_end + 1;
+    const size_t free_end = tb->arena_start - tb->arena_start % sizeof(var_t);
+    if (free_end < free_start || (uvar_t)last >= (free_end - free_start) / sizeof(var_t))
+      return print_error(tb, str_err_out_of_memory, initial_index);
+    const size_t length = (size_t)last + 1;
+    tb->arena_start = free_end - length * sizeof(var_t);
+    tb->array_start[variable] = tb->arena_start;
+    tb->array_length[variable] = length;
+    memset(&tb->codemem[tb->arena_start], 0, length * sizeof(var_t));
+
+    // More arrays can follow after a comma
+    index++;
+    skip_spaces(tb, &index);
+    if (tb->codemem[index] == '\0')
+      return 0;
+    if (tb->codemem[index] != ',')
+      return print_error(tb, str_err_dim_target, initial_index);
+    index++;
+  }
+}
+#endif
+
+#if CONTROL_STACK_SIZE > 0
+/**
+ * Decode the for command, find the loop variable, start, limit and step expressions
+ */
+bool decode_for(Interpreter *tb, size_t index, Statement *stmt)
+{
+  STATS_ADD(ST_STMT_DECODES, 1);
+  stmt->command = 0;
+  const size_t initial_index = index;
+
+  // Get the loop variable
+  index++;
+  skip_spaces(tb, &index);
+  if (!isalpha(tb->codemem[index])) {
+    print_error(tb, str_err_for_target, initial_index);
+    return true;
+  }
+  stmt->variable = toupper(tb->codemem[index]) - 'A';
+
+  // Check for the equal symbol sanity
+  index++;
+  skip_spaces(tb, &index);
+  if (tb->codemem[index] != '=') {
+    print_error(tb, str_err_let_sanity, initial_index);
+    return true;
+  }
+
+  // Get the start expression
+  index++;
+  size_t length = 0;
+  while (tb->codemem[index + length] != '\0' && (uint8_t)tb->codemem[index + length] != TK_TO)
+    length++;
+  if (tb->codemem[index + length] == '\0') {
+    print_error(tb, str_err_for_to, initial_index);
+    return true;
+  }
+  stmt->expr_index[0] = index;
+  stmt->expr_length[0] = length;
+
+  // Get the limit and the optional step expressions (the step index is 0 without it)
+  index += length + 1;
+  length = 0;
+  while (tb->codemem[index + length] != '\0' && (uint8_t)tb->codemem[index + length] != TK_STEP)
+    length++;
+  stmt->expr_index[1] = index;
+  stmt->expr_length[1] = length;
+  index += length;
+  stmt->expr_index[2] = 0;
+  stmt->expr_length[2] = 0;
+  if (tb->codemem[index] != '\0') {
+    stmt->expr_index[2] = ++index;
+    stmt->expr_length[2] = strlen(&tb->codemem[index]);
+  }
+
+  stmt->command = TK_FOR;
+  stmt->index = initial_index;
+  return false;
+}
+
+/**
+ * Start the loop, assign the start value and push its frame on the control stack
+ */
+bool control_for(Interpreter *tb, size_t index, size_t position)
+{
+  Statement local;
+  Statement *stmt = stmt_slot(tb, index, &local);
+  if (!stmt_decoded(stmt, index) && decode_for(tb, index, stmt))
+    return true;
+
+  // Solve the start, limit and step expressions
+  bool error;
+  const var_t start = expr_solve(tb, stmt->expr_index[0], stmt->expr_length[0], &error);
+  if (error)
+    return true;
+  const var_t limit = expr_solve(tb, stmt->expr_index[1], stmt->expr_length[1], &error);
+  if (error)
+    return true;
+  var_t step = 1;
+  if (stmt->expr_index[2]) {
+    step = expr_solve(tb, stmt->expr_index[2], stmt->expr_length[2], &error);
+    if (error)
+      return true;
+  }
+
+  // Starting the same loop again drops it and the loops left inside it
+  for (size_t depth = tb->control_depth; depth && tb->control_stack[depth - 1].variable != CF_GOSUB; depth--) {
+    if (tb->control_stack[depth - 1].variable == stmt->variable) {
+      tb->control_depth = depth - 1;
+      break;
+    }
+  }
+  if (tb->control_depth == CONTROL_STACK_SIZE) {
+    print_error(tb, str_err_control_full, index);
+    return true;
+  }
+
+  ControlFrame *frame = &tb->control_stack[tb->control_depth++];
+  frame->position = position;
+  frame->variable = stmt->variable;
+  frame->limit = limit;
+  frame->step = step;
+  tb->variables[stmt->variable] = start;
+  return false;
+}
+
+/**
+ * Step the loop variable, resume gets the loop frame if it has to be repeated
+ */
+bool control_next(Interpreter *tb, size_t index, ControlFrame **resume)
+{
+  const size_t initial_index = index;
+  *resume = NULL;
+
+  // Get the optional loop variable
+  uint8_t variable = CF_ANY;
+  index++;
+  skip_spaces(tb, &index);
+  if (isalpha(tb->codemem[index])) {
+    variable = toupper(tb->codemem[index]) - 'A';
+    index++;
+    skip_spaces(tb, &index);
+  }
+  if (tb->codemem[index] != '\0') {
+    print_error(tb, str_err_char_garbage, initial_index);
+    return true;
+  }
+
+  // Find the loop, the loops left inside it are dropped
+  for (size_t depth = tb->control_depth; depth && tb->control_stack[depth - 1].variable != CF_GOSUB; depth--) {
+    ControlFrame *frame = &tb->control_stack[depth - 1];
+    if (variable != CF_ANY && frame->variable != variable)
+      continue;
+
+    // Repeat if the stepped value doesn't go past the limit (checked before the step so it can't overflow)
+    const var_t value = tb->variables[frame->variable];
+    const bool repeat = (frame->step >= 0) ?
+      (value <= frame->limit && (uvar_t)frame->limit - (uvar_t)value >= (uvar_t)frame->step) :
+      (value >= frame->limit && (uvar_t)value - (uvar_t)frame->limit >= (uvar_t)0 - (uvar_t)frame->step);
+    tb->variables[frame->variable] = (var_t)((uvar_t)value + (uvar_t)frame->step);
+    if (repeat) {
+      tb->control_depth = depth;
+      *resume = frame;
+    } else {
+      tb->control_depth = depth - 1;
+    }
+    return false;
+  }
+
+  print_error(tb, str_err_next_no_for, initial_index);
+  return true;
+}
+
+/**
+ * Push the subroutine call frame on the control stack
+ */
+bool control_gosub(Interpreter *tb, size_t index, size_t position)
+{
+  if (tb->control_depth == CONTROL_STACK_SIZE) {
+    print_error(tb, str_err_control_full, index);
+    return true;
+  }
+  ControlFrame *frame = &tb->control_stack[tb->control_depth++];
+  frame->position = position;
+  frame->variable = CF_GOSUB;
+  return false;
+}
+
+/**
+ * Leave the subroutine, resume gets the call frame and the loops left inside are dropped
+ */
+bool control_return(Interpreter *tb, size_t index, ControlFrame **resume)
+{
+  while (tb->control_depth) {
+    ControlFrame *frame = &tb->control_stack[--tb->control_depth];
+    if (frame->variable == CF_GOSUB) {
+      *resume = frame;
+      return false;
+    }
+  }
+  print_error(tb, str_err_return_no_gosub, index);
+  return true;
+}
+
+/**
+ * Handle the control commands outside of the RUN loop, the frame to resume at is left in tb->control_resume
+ */
+line_t handle_control(Interpreter *tb, size_t index)
+{
+  if (!tb->current_line)
+    return print_error(tb, str_err_run_only, index);
+
+  // Find the running line position
+  #if LINE_INDEX == 1
+  const size_t position = line_index_find(tb, tb->current_line);
+  #else
+  const size_t position = index;
+  #endif
+
+  ControlFrame *resume = NULL;
+  switch ((uint8_t)tb->codemem[index]) {
+    case TK_FOR:
+      if (control_for(tb, index, position))
+        return MAX_LINENUM;
+      break;
+
+    case TK_NEXT:
+      if (control_next(tb, index, &resume))
+        return MAX_LINENUM;
+      break;
+
+    case TK_RETURN:
+      if (control_return(tb, index, &resume))
+        return MAX_LINENUM;
+      break;
+
+    // Do the call like 'GOTO'
+    case TK_GOSUB: {
+      Statement local;
+      Statement *stmt = stmt_slot(tb, index, &local);
+      if (!stmt_decoded(stmt, index) && decode_goto(tb, index, stmt))
+        return MAX_LINENUM;
+      if (control_gosub(tb, index, position))
+        return MAX_LINENUM;
+      return stmt->target;
+    }
+  }
+
+  tb->control_resume = resume;
+  return (resume) ? MAX_LINENUM : 0;
+}
+#endif
+
+#if POKE_PEEK == 1
+/**
+ * Poke in memory, change some values
+ */
+line_t handle_poke(Interpreter *tb, size_t index, bool byte_size)
+{
+  bool error;
+  const size_t initial_index = index;
+  index++;
+  skip_spaces(tb, &index);
+
+  // Get the first expression
+  size_t length = 0;
+  while (tb->codemem[index + length] != '\0' && tb->codemem[index + length] != ',')
+    length++;
+  if (tb->codemem[index + length] == '\0')
+    return print_error(tb, str_err_poke_exprs, initial_index);
+  size_t address = expr_solve(tb, index, length, &error);
+  if (error)
+    return MAX_LINENUM;
+
+  // Get the second expression
+  index += length + 1;
+  length = 0;
+  while (tb->codemem[index + length] != '\0')
+    length++;
+  peek_t value = expr_solve(tb, index, length, &error);
+  if (error)
+    return MAX_LINENUM;
+
+  // Do the memory operation
+  if (byte_size) {
+    *(uint8_t*)(address) = (uint8_t)value;
+  } else {
+    *(peek_t*)(address) = (peek_t)value;
+  }
+
+  return 0;
+}
+
+/**
+ * Peek into the memory, get some values
+ */
+line_t handle_peek(Interpreter *tb, size_t index, bool byte_size)
+{
+  bool error;
+  const size_t initial_index = index;
+  index++;
+  skip_spaces(tb, &index);
+
+  // Get the first expression
+  size_t length = 0;
+  while (tb->codemem[index + length] != '\0' && tb->codemem[index + length] != ',')
+    length++;
+  if (tb->codemem[index + length] == '\0')
+    return print_error(tb, str_err_peek_exprs, initial_index);
+  size_t address = expr_solve(tb, index, length, &error);
+  if (error)
+    return MAX_LINENUM;
+
+  // Get the variable target
+  index += length + 1;
+  skip_spaces(tb, &index);
+  if (!isalpha(tb->codemem[index]) || tb->codemem[index + 1] != '\0')
+    return print_error(tb, str_err_peek_target, initial_index);
+  size_t variable = toupper(tb->codemem[index]) - 'A';
+
+  // Do the memory operation
+  tb->variables[variable] = (byte_size) ?
+    (var_t)(*(uint8_t*)(address)) : (var_t)(*(peek_t*)(address));
+  return 0;
+}
+#endif
+
+#if FILE_IO == 1
+/**
+ * Save the memory contents to a file, as text or as the binary image
+ */
+void handle_save(Interpreter *tb, size_t index, bool binary)
+{
+  // Get the file name
+  const size_t initial_index = index;
+  index++;
+  skip_spaces(tb, &index);
+
+  // Check if the code exists
+  if (tb->codemem_end == 0) {
+    print_error(tb, str_err_save_no_code, initial_index);
+    return;
+  }
+
+  // Open a file
+  const char *filename = &tb->codemem[index];
+  FILE *file = fopen(filename, (binary) ? "wb" : "w");
+  if (file == NULL) {
+    print_error(tb, str_err_save_file, initial_index);
+    return;
+  }
+
+  // Write the image header and the memory as it is
+  if (binary) {
+    uint8_t header[IMAGE_HEADER_SIZE];
+    image_header(header, tb->codemem_end);
+    if (fwrite(header, 1, IMAGE_HEADER_SIZE, file) != IMAGE_HEADER_SIZE ||
+        fwrite(tb->codemem, 1, tb->codemem_end, file) != tb->codemem_end)
+      print_error(tb, str_err_save_file, initial_index);
+    fclose(file);
+    return;
+  }
+
+  // Write to the file
+  size_t mem_index = sizeof(line_t);
+  while (mem_index < tb->codemem_end) {
+    fprintf(file, "%d ", load_line_t(tb, mem_index - sizeof(line_t)));
+    uint8_t state = DS_CODE;
+    while (tb->codemem[mem_index] != '\0') {
+      char buffer[NUMBER_BUFFER_SIZE];
+      mem_index = detokenize(tb, mem_index, buffer, &state);
+      fputs(buffer, file);
+    }
+    fputc('\n', file);
+    mem_index += sizeof(line_t) + 1;
+  }
+
+  // Close the file
+  fclose(file);
+}
+
+/**
+ * Load the memory contents from a file
+ */
+void handle_load(Interpreter *tb, size_t index)
+{
+  const size_t initial_index = index;
+  index++;
+  skip_spaces(tb, &index);
+
+  if (load_file(tb, &tb->codemem[index]))
+    print_error(tb, str_err_load_file, initial_index);
+}
+
+/**
+ * Load the program lines or the image from the file, return true if it can't be loaded
+ */
+bool load_file(Interpreter *tb, const char *filename)
+{
+  FILE *file = fopen(filename, "rb");
+  if (file == NULL)
+    return true;
+
+  // Read the binary image if the file starts with its header
+  uint8_t header[IMAGE_HEADER_SIZE];
+  if (fread(header, 1, IMAGE_HEADER_SIZE, file) == IMAGE_HEADER_SIZE &&
+      memcmp(header, IMAGE_MAGIC, 4) == 0) {
+    const bool error = load_image(tb, file, header);
+    fclose(file);
+    return error;
+  }
+  rewind(file);
+
+  // Lines are only appended after the existing ones, so the caches are cleared once
+  code_changed(tb);
+  line_t last_linenum = get_last_line_num(tb);
+
+  while (1) {
+
+    // Read the line straight into the new line buffer, stop if the rest of the file doesn't fit
+    const size_t space = codemem_free_end(tb) - tb->newline_ind;
+    if (space < 2) {
+      int chr;
+      while ((chr = fgetc(file)) != EOF && isspace(chr));
+      if (chr != EOF) {
+        print_string(tb, str_err_out_of_memory);
+        tb->error_reported = true;
+      }
+      break;
+    }
+    if (fgets(&tb->codemem[tb->newline_ind], (int)space, file) == NULL)
+      break;
+    tb->newline_end = tb->newline_ind + strlen(&tb->codemem[tb->newline_ind]);
+    bool overflow = false;
+    if (tb->newline_end > tb->newline_ind && tb->codemem[tb->newline_end - 1] == '\n')
+      tb->codemem[--tb->newline_end] = '\0';
+    else if (!feof(file))
+      overflow = true;
+
+    // Skip if line doesn't seem to be valid
+    if (!isdigit(tb->codemem[tb->newline_ind])) {
+      for (int chr = 0; overflow && chr != '\n' && chr != EOF; chr = fgetc(file));
+      continue;
+    }
+
+    // Stop if the line doesn't fit in the free memory
+    if (overflow) {
+      print_string(tb, str_err_out_of_memory);
+      tb->error_reported = true;
+      break;
+    }
+
+    // Append the line if it comes in order, merge it in like a typed one otherwise
+    const line_t linenum = append_newline(tb, last_linenum);
+    if (linenum) {
+      last_linenum = linenum;
+      tb->newline_ind = tb->codemem_end;
+    } else {
+      execute_newline(tb);
+    }
+  }
+
+  fclose(file);
+  #if GAP_BUFFER == 1
+  gap_close(tb);
+  #endif
+  tb->newline_ind = tb->codemem_end;
+  tb->newline_end = tb->codemem_end;
+  return false;
+}
+
+/**
+ * Get the number of the last line in the program, 0 if there's no code
+ */
+line_t get_last_line_num(Interpreter *tb)
+{
+  #if LINE_INDEX == 1
+  return (tb->line_count) ? tb->line_index[tb->line_count - 1].linenum : 0;
+  #else
+  line_t linenum = 0;
+  for (size_t index = 0; index < tb->codemem_end; index += strlen(&tb->codemem[index + sizeof(line_t)]) + sizeof(line_t) + 1)
+    linenum = load_line_t(tb, index);
+  return linenum;
+  #endif
+}
+
+/**
+ * Put the new line after the last one without searching, return its number or 0 if it has to be merged
+ */
+line_t append_newline(Interpreter *tb, line_t last_linenum)
+{
+  // Lines can only be appended if they come after the last one
+  const line_t linenum = get_line_num(tb, tb->newline_ind);
+  if (linenum <= last_linenum)
+    return 0;
+  #if GAP_BUFFER == 1
+  if (tb->gap_end != CODE_MEMORY_SIZE)
+    return 0;
+  #endif
+
+  // Get the index after the number and tokenize the line in place
+  size_t ind = tb->newline_ind;
+  while (isalnum(tb->codemem[ind]) && ind < tb->newline_end)
+    ind++;
+  skip_spaces(tb, &ind);
+  tb->newline_end = tokenize_line(tb, ind, tb->newline_end);
+
+  // There's nothing to delete if the line is empty
+  size_t newlinelen = tb->newline_end - ind;
+  while (newlinelen && isblank(tb->codemem[ind + newlinelen - 1]))
+    newlinelen--;
+  if (!newlinelen)
+    return linenum;
+
+  // Check if there's memory for the command
+  if (CODE_MEMORY_SIZE - tb->codemem_end < newlinelen + 8) {
+    print_string(tb, str_err_out_of_memory);
+    tb->error_reported = true;
+    return linenum;
+  }
+
+  // Put the line at the end of the code
+  memmove(&tb->codemem[tb->codemem_end + sizeof(line_t)], &tb->codemem[ind], newlinelen);
+  store_line_t(tb, tb->codemem_end, linenum);
+  tb->codemem[tb->codemem_end + newlinelen + sizeof(line_t)] = '\0';
+  #if LINE_INDEX == 1
+  line_index_insert(tb, tb->line_count, linenum, tb->codemem_end, 0);
+  #endif
+  tb->codemem_end += newlinelen + sizeof(line_t) + 1;
+  return linenum;
+}
+
+/**
+ * Fill the binary image header for the code of the given length
+ */
+void image_header(uint8_t *header, size_t length)
+{
+  memcpy(header, IMAGE_MAGIC, 4);
+  header[4] = IMAGE_VERSION;
+  header[5] = sizeof(line_t);
+  header[6] = KEYWORD_COUNT;
+  for (size_t i = 0; i < 4; i++) {
+    header[7 + i] = (uint8_t)((uint32_t)CODE_MEMORY_SIZE >> (i * 8));
+    header[11 + i] = (uint8_t)((uint32_t)length >> (i * 8));
+  }
+}
+
+/**
+ * Read the code memory image after the header, return true if it doesn't fit or is broken
+ */
+bool load_image(Interpreter *tb, FILE *file, const uint8_t *header)
+{
+  // The image has to come from the same format of the code memory
+  uint8_t expected[IMAGE_HEADER_SIZE];
+  image_header(expected, 0);
+  if (memcmp(header, expected, 7) != 0)
+    return true;
+  uint32_t length = 0;
+  for (size_t i = 4; i; i--)
+    length = (length << 8) | header[10 + i];
+  if (length >= CODE_MEMORY_SIZE)
+    return true;
+
+  // Read it straight into place
+  clear_code(tb);
+  if (fread(tb->codemem, 1, length, file) != length || restore_code(tb, length)) {
+    clear_code(tb);
+    return true;
+  }
+  return false;
+}
+
+/**
+ * Take the lines put straight into the code memory and rebuild the line index, return true if they're broken
+ */
+bool restore_code(Interpreter *tb, size_t length)
+{
+  line_t last_linenum = 0;
+  size_t index = 0;
+  while (index < length) {
+
+    // Line numbers have to be valid and ascending
+    if (index + sizeof(line_t) >= length)
+      return true;
+    const line_t linenum = load_line_t(tb, index);
+    if (linenum <= last_linenum || linenum >= MAX_LINENUM)
+      return true;
+
+    // Line text has to end before the end of the code
+    const char *end = (const char*)memchr(&tb->codemem[index + sizeof(line_t)], '\0', length - index - sizeof(line_t));
+    if (end == NULL || end == &tb->codemem[index + sizeof(line_t)])
+      return true;
+    #if LINE_INDEX == 1
+    line_index_insert(tb, tb->line_count, linenum, index, 0);
+    #endif
+
+    last_linenum = linenum;
+    index = end - tb->codemem + 1;
+  }
+
+  tb->codemem_end = length;
+  tb->newline_ind = length;
+  tb->newline_end = length;
+  code_changed(tb);
+  return false;
+}
+#endif
+
+#if BATCH_MODE == 1
+/**
+ * Load and run the program from the file without the shell, return the exit code
+ */
+int run_file(Interpreter *tb, const char *filename)
+{
+  int result = 2;
+  if (load_file(tb, filename)) {
+    print_string(tb, str_err);
+    print_string(tb, str_err_load_file);
+    print_string(tb, str_lf);
+  } else {
+
+    // Don't run the program if some of the lines failed to load
+    if (!tb->error_reported)
+      handle_run(tb);
+    result = (tb->error_reported) ? 1 : 0;
+  }
+
+  #if OUTPUT_BUFFER_SIZE > 0
+  output_flush(tb);
+  #endif
+  return result;
+}
+
+#if STATS == 1
+/**
+ * Write the runtime counters as a JSON object on a single line
+ */
+void stats_json(FILE *file, const unsigned long *stats)
+{
+  for (size_t i = 0; i < ST_COUNT; i++)
+    fprintf(file, "%c\"%s\":%lu", (i) ? ',' : '{', stats_names[i], stats[i]);
+  fputs("}\n", file);
+}
+#endif
+#endif
+
+#if BATCH_THREADS > 0
+/**
+ * Append the data to the output of the current job, it's dropped if there's no memory
+ */
+void batch_write(BatchWorker *worker, const char *data, size_t length)
+{
+  if (worker->output_length + length > worker->output_size) {
+    size_t size = (worker->output_size) ? worker->output_size : 256;
+    while (size < worker->output_length + length)
+      size *= 2;
+    char *output = (char *)realloc(worker->output, size);
+    if (!output)
+      return;
+    worker->output = output;
+    worker->output_size = size;
+  }
+  memcpy(&worker->output[worker->output_length], data, length);
+  worker->output_length += length;
+}
+
+/**
+ * Collect a character sent by the job
+ */
+void batch_put(void *user, char chr)
+{
+  batch_write((BatchWorker *)user, &chr, 1);
+}
+
+/**
+ * Read a character from the job input, empty lines after its end
+ */
+char batch_get(void *user)
+{
+  BatchWorker *worker = (BatchWorker *)user;
+  const int chr = (worker->input) ? fgetc(worker->input) : EOF;
+  return (chr == EOF) ? NEWLINE : (char)chr;
+}
+
+/**
+ * Jobs don't get interrupted
+ */
+bool batch_check(void *user)
+{
+  (void)user;
+  return false;
+}
+
+/**
+ * Collect a block of characters sent by the job
+ */
+void batch_flush(void *user, const char *buffer, size_t length)
+{
+  batch_write((BatchWorker *)user, buffer, length);
+}
+
+/**
+ * Read a block of the job input, every 'INPUT' after its end gets an empty line
+ */
+size_t batch_read(void *user, char *buffer, size_t size)
+{
+  BatchWorker *worker = (BatchWorker *)user;
+  return (worker->input) ? fread(buffer, 1, size, worker->input) : 0;
+}
+
+/**
+ * Take the next job of the worker, steal half of the jobs left to another worker when it runs out
+ */
+bool batch_take(BatchRunner *runner, size_t self, size_t *job)
+{
+  BatchWorker *worker = &runner->workers[self];
+  pthread_mutex_lock(&worker->lock);
+  const bool taken = worker->next < worker->end;
+  if (taken)
+    *job = worker->next++;
+  pthread_mutex_unlock(&worker->lock);
+  if (taken)
+    return true;
+
+  for (size_t i = 1; i < runner->worker_count; i++) {
+    BatchWorker *victim = &runner->workers[(self + i) % runner->worker_count];
+    pthread_mutex_lock(&victim->lock);
+    const size_t left = victim->end - victim->next;
+    const size_t stolen = left - left / 2;
+    victim->end -= stolen;
+    const size_t first = victim->end;
+    pthread_mutex_unlock(&victim->lock);
+    if (!stolen)
+      continue;
+
+    // Run the first stolen job and keep the rest
+    pthread_mutex_lock(&worker->lock);
+    *job = first;
+    worker->next = first + 1;
+    worker->end = first + stolen;
+    pthread_mutex_unlock(&worker->lock);
+    return true;
+  }
+  return false;
+}
+
+/**
+ * Run the jobs of a worker, print the result line and the output of every job
+ */
+void *batch_worker(void *arg)
+{
+  BatchWorker *worker = (BatchWorker *)arg;
+  BatchRunner *runner = worker->runner;
+  const size_t self = (size_t)(worker - runner->workers);
+  const InterpreterIO io = { batch_put, batch_get, batch_check, batch_flush, batch_read, worker };
+
+  size_t job;
+  while (batch_take(runner, self, &job)) {
+    const BatchJob *current = &runner->jobs[job];
+    worker->output_length = 0;
+    worker->input = NULL;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int result = 2;
+    if (!current->input || (worker->input = fopen(current->input, "rb"))) {
+      interpreter_init(worker->tb, &io);
+      #if RUN_LIMITS == 1
+      interpreter_limit(worker->tb, runner->line_limit, runner->time_limit);
+      #endif
+      result = run_file(worker->tb, current->program);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (worker->input)
+      fclose(worker->input);
+    const double ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+
+    // Result line: program, input, exit code, time and the output length, then the output on its own lines
+    pthread_mutex_lock(&runner->print_lock);
+    printf("# %s %s %d %.3f %zu\n", current->program, (current->input) ? current->input : "-",
+      result, ms, worker->output_length);
+    fwrite(worker->output, 1, worker->output_length, stdout);
+    if (worker->output_length && worker->output[worker->output_length - 1] != '\n')
+      putchar('\n');
+    if (result > runner->result)
+      runner->result = result;
+    #if STATS == 1
+    for (size_t i = 0; i < ST_COUNT; i++)
+      runner->stats[i] += worker->tb->stats[i];
+    #endif
+    pthread_mutex_unlock(&runner->print_lock);
+  }
+  return NULL;
+}
+
+/**
+ * Run the jobs on a pool of worker threads with the limits of every run, return the highest exit code
+ */
+int batch_run(const BatchJob *jobs, size_t count, size_t threads, unsigned long line_limit, unsigned long time_limit)
+{
+  if (threads > count)
+    threads = count;
+  if (!threads)
+    return 0;
+
+  BatchRunner runner;
+  runner.jobs = jobs;
+  runner.worker_count = threads;
+  runner.result = 0;
+  runner.line_limit = line_limit;
+  runner.time_limit = time_limit;
+  #if STATS == 1
+  for (size_t i = 0; i < ST_COUNT; i++)
+    runner.stats[i] = 0;
+  #endif
+  runner.workers = (BatchWorker *)calloc(threads, sizeof(BatchWorker));
+  if (!runner.workers)
+    return 2;
+  pthread_mutex_init(&runner.print_lock, NULL);
+
+  // Every worker starts with an even share of the jobs
+  size_t started = 0;
+  for (size_t i = 0; i < threads; i++) {
+    BatchWorker *worker = &runner.workers[i];
+    worker->runner = &runner;
+    worker->next = count * i / threads;
+    worker->end = count * (i + 1) / threads;
+    pthread_mutex_init(&worker->lock, NULL);
+    worker->tb = (Interpreter *)malloc(sizeof(Interpreter));
+    if (!worker->tb)
+      break;
+    started++;
+  }
+
+  // Workers that couldn't start leave their jobs to be stolen
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < started; i++)
+    pthread_create(&runner.workers[i].thread, NULL, batch_worker, &runner.workers[i]);
+  for (size_t i = 0; i < started; i++)
+    pthread_join(runner.workers[i].thread, NULL);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  fflush(stdout);
+
+  const double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  fprintf(stderr, "%zu jobs on %zu threads in %.3f s, %.0f jobs/s\n",
+    count, started, seconds, (seconds > 0) ? count / seconds : 0.0);
+  #if STATS == 1
+  stats_json(stderr, runner.stats);
+  #endif
+
+  for (size_t i = 0; i < threads; i++) {
+    free(runner.workers[i].tb);
+    free(runner.workers[i].output);
+    pthread_mutex_destroy(&runner.workers[i].lock);
+  }
+  pthread_mutex_destroy(&runner.print_lock);
+  free(runner.workers);
+  return (started) ? runner.result : 2;
+}
+
+/**
+ * Add a job to the list, return true if there's no memory
+ */
+bool batch_add(BatchList *list, const char *program, const char *input)
+{
+  if (list->count == list->size) {
+    const size_t size = (list->size) ? list->size * 2 : 64;
+    BatchJob *jobs = (BatchJob *)realloc(list->jobs, size * sizeof(BatchJob));
+    if (!jobs)
+      return true;
+    list->jobs = jobs;
+    list->size = size;
+  }
+  list->jobs[list->count].program = program;
+  list->jobs[list->count].input = input;
+  list->jobs[list->count].owned = false;
+  list->count++;
+  return false;
+}
+
+/**
+ * Add a program or every .bas file of a directory to the list, return true on failure
+ */
+bool batch_add_path(BatchList *list, const char *path)
+{
+  struct stat info;
+  if (stat(path, &info) || !S_ISDIR(info.st_mode))
+    return batch_add(list, path, NULL);
+
+  DIR *dir = opendir(path);
+  if (!dir)
+    return true;
+  bool failed = false;
+  struct dirent *entry;
+  while (!failed && (entry = readdir(dir))) {
+    const size_t length = strlen(entry->d_name);
+    if (length < 4 || strcmp(&entry->d_name[length - 4], ".bas"))
+      continue;
+
+    const size_t path_length = strlen(path);
+    char *name = (char *)malloc(path_length + length + 2);
+    if (!name) {
+      failed = true;
+      break;
+    }
+    memcpy(name, path, path_length);
+    name[path_length] = '/';
+    memcpy(&name[path_length + 1], entry->d_name, length + 1);
+    failed = batch_add(list, name, NULL);
+    if (failed)
+      free(name);
+    else
+      list->jobs[list->count - 1].owned = true;
+  }
+  closedir(dir);
+  return failed;
+}
+
+/**
+ * Run the batch jobs from the command line: [-j threads] [-l lines] [-t ms] program|directory...
+ * or [-j threads] [-l lines] [-t ms] -i program input..., return the highest exit code
+ */
+int batch_main(int argc, char **argv)
+{
+  size_t threads = BATCH_THREADS;
+  unsigned long line_limit = 0, time_limit = 0;
+  const char *program = NULL;
+  int arg = 1;
+  for (; arg < argc && argv[arg][0] == '-'; arg++) {
+    if (!strcmp(argv[arg], "-j") && arg + 1 < argc)
+      threads = (size_t)strtoul(argv[++arg], NULL, 10);
+    #if RUN_LIMITS == 1
+    else if (!strcmp(argv[arg], "-l") && arg + 1 < argc)
+      line_limit = strtoul(argv[++arg], NULL, 10);
+    else if (!strcmp(argv[arg], "-t") && arg + 1 < argc)
+      time_limit = strtoul(argv[++arg], NULL, 10);
+    #endif
+    else if (!strcmp(argv[arg], "-i") && arg + 1 < argc)
+      program = argv[++arg];
+    else
+      break;
+  }
+
+  BatchList list = { NULL, 0, 0 };
+  bool failed = false;
+  for (; arg < argc && !failed; arg++)
+    failed = (program) ? batch_add(&list, program, argv[arg]) : batch_add_path(&list, argv[arg]);
+  const int result = (failed) ? 2 : batch_run(list.jobs, list.count, (threads) ? threads : 1, line_limit, time_limit);
+  if (failed)
+    fprintf(stderr, "Failed to list the jobs\n");
+
+  for (size_t i = 0; i < list.count; i++)
+    if (list.jobs[i].owned)
+      free((char *)list.jobs[i].program);
+  free(list.jobs);
+  return result;
+}
+#endif
+
+/**
+ * Ask for confirmation and if confirmed clear the memory
+ */
+void handle_new(Interpreter *tb)
+{
+  print_string(tb, str_new_confirm);
+  #if STEP_API == 1
+  // The answer comes from tb_feed_char()
+  if (tb->step_state == STEP_LINE) {
+    tb->step_state = STEP_CONFIRM;
+    return;
+  }
+  #endif
+  char chr;
+  INPUT_CHAR(&chr);
+  confirm_new(tb, chr);
+}
+
+/**
+ * Clear the memory if the answer to 'NEW' is yes
+ */
+void confirm_new(Interpreter *tb, char chr)
+{
+  if (toupper(chr) == 'Y') {
+    print_string(tb, str_lf);
+    print_string(tb, str_new_confirm_accept);
+    print_string(tb, str_lf);
+    clear_code(tb);
+  } else {
+    print_string(tb, str_lf);
+  }
+}
+
+/**
+ * Clear the code memory
+ */
+void clear_code(Interpreter *tb)
+{
+  for (int i = 0; i < CODE_MEMORY_SIZE; i++)
+    tb->codemem[i] = '\0';
+  tb->codemem_end = 0;
+  tb->newline_ind = 0;
+  tb->newline_end = 0;
+  #if GAP_BUFFER == 1
+  tb->gap_end = CODE_MEMORY_SIZE;
+  #endif
+  #if LINE_INDEX == 1
+  tb->line_count = 0;
+  #endif
+  code_changed(tb);
+}
+
+#if RUN_ANALYZER == 0
+/**
+ * Find the 'GOTO' or 'GOSUB' token in the line (the only one that can be executed)
+ */
+size_t find_goto(Interpreter *tb, size_t index)
+{
+  bool string = false;
+  for (; tb->codemem[index] != '\0'; index++) {
+    const uint8_t chr = tb->codemem[index];
+    if (chr == '"')
+      string = !string;
+    else if (string)
+      continue;
+    else if (chr == TK_GOTO || chr == TK_GOSUB)
+      return index;
+    else if (chr == TK_REM || chr == TK_SAVE || chr == TK_BSAVE || chr == TK_LOAD)
+      break;
+  }
+  return 0;
+}
+
+/**
+ * Resolve the 'GOTO' targets of all lines, return true if some target doesn't exist
+ */
+bool resolve_jumps(Interpreter *tb)
+{
+  size_t line = 0, slot = 0;
+  for (; line < tb->codemem_end; line += strlen(&tb->codemem[line + sizeof(line_t)]) + sizeof(line_t) + 1, slot++) {
+    size_t index = find_goto(tb, line + sizeof(line_t));
+    #if LINE_INDEX == 1
+    tb->line_index[slot].jump = NO_JUMP;
+    #endif
+    if (!index)
+      continue;
+
+    // Get the target, invalid ones are reported when executed
+    bool error;
+    index++;
+    skip_spaces(tb, &index);
+    const line_t linenum = get_number(tb, &index, &error);
+    if (linenum <= 0 || linenum >= MAX_LINENUM || error)
+      continue;
+
+    // Find the target line
+    #if LINE_INDEX == 1
+    const size_t target = line_index_find(tb, linenum);
+    if (target < tb->line_count && tb->line_index[target].linenum == linenum) {
+      tb->line_index[slot].jump = target;
+      continue;
+    }
+    #else
+    if (get_line_index(tb, linenum) < tb->codemem_end)
+      continue;
+    #endif
+
+    print_string(tb, str_err_line_not_found1);
+    print_unsigned(tb, linenum);
+    print_string(tb, str_err_line_not_found2);
+    print_string(tb, str_lf);
+    tb->error_reported = true;
+    return true;
+  }
+
+  return false;
+}
+#else
+/**
+ * Decode the 'GOTO' or 'GOSUB' and resolve its target for the line slot, return true if it's invalid
+ */
+bool analyze_jump(Interpreter *tb, size_t index, size_t slot)
+{
+  Statement local;
+  Statement *stmt = stmt_slot(tb, index, &local);
+  if (!stmt_decoded(stmt, index) && decode_goto(tb, index, stmt))
+    return true;
+
+  #if LINE_INDEX == 1
+  const size_t target = line_index_find(tb, stmt->target);
+  if (target < tb->line_count && tb->line_index[target].linenum == stmt->target) {
+    tb->line_index[slot].jump = target;
+    return false;
+  }
+  #else
+  (void)slot;
+  if (get_line_index(tb, stmt->target) < tb->codemem_end)
+    return false;
+  #endif
+
+  print_string(tb, str_err_line_not_found1);
+  print_unsigned(tb, stmt->target);
+  print_string(tb, str_err_line_not_found2);
+  print_string(tb, str_lf);
+  tb->error_reported = true;
+  return true;
+}
+
+/**
+ * Check the statement expression unless it's fused (it's valid then and it isn't solved)
+ */
+static inline bool analyze_value(Interpreter *tb, const Statement *stmt, size_t i)
+{
+  #if STMT_FUSION == 1
+  if (stmt->operand[i] != FO_EXPRESSION)
+    return false;
+  #endif
+  return expr_check(tb, stmt->expr_index[i], stmt->expr_length[i]);
+}
+
+/**
+ * Decode all the parts of the 'PRINT' and check their expressions, return true if some is invalid
+ */
+bool analyze_print(Interpreter *tb, size_t index)
+{
+  const size_t initial_index = index;
+  index++;
+
+  while (1) {
+    Statement local;
+    Statement *stmt = stmt_slot(tb, index, &local);
+    if (!stmt_decoded(stmt, index) && decode_print(tb, index, initial_index, stmt))
+      return true;
+    if (stmt->command == PP_EXPRESSION && expr_check(tb, stmt->expr_index[0], stmt->expr_length[0]))
+      return true;
+
+    switch (stmt->compare) {
+      case PE_CONTINUE:
+        index = stmt->next;
+        break;
+
+      case PE_GARBAGE:
+        print_error(tb, str_err_str_garbage, initial_index);
+        return true;
+
+      default:
+        return false;
+    }
+  }
+}
+
+/**
+ * Check the command the way it's executed and decode it for the run, return true if it would fail
+ */
+bool analyze_command(Interpreter *tb, size_t index, size_t slot)
+{
+  Statement local;
+  Statement *stmt;
+
+  switch ((uint8_t)tb->codemem[index]) {
+    case TK_LET:
+      index++;
+    analyze_let:
+      stmt = stmt_slot(tb, index, &local);
+      if (!stmt_decoded(stmt, index) && decode_let(tb, index, stmt))
+        return true;
+      #if ARRAYS == 1
+      if ((stmt->variable & VARIABLE_ARRAY) && expr_check(tb, stmt->expr_index[1], stmt->expr_length[1]))
+        return true;
+      #endif
+      return analyze_value(tb, stmt, 0);
+
+    case TK_PRINT:
+      return analyze_print(tb, index);
+
+    // Check the command after 'THEN' as well
+    case TK_IF:
+      stmt = stmt_slot(tb, index, &local);
+      if (!stmt_decoded(stmt, index) && decode_if(tb, index, stmt))
+        return true;
+      if (analyze_value(tb, stmt, 0) || analyze_value(tb, stmt, 1))
+        return true;
+      return analyze_command(tb, stmt->next, slot);
+
+    case TK_GOTO:
+    #if CONTROL_STACK_SIZE > 0
+    case TK_GOSUB:
+    #endif
+      return analyze_jump(tb, index, slot);
+
+    #if CONTROL_STACK_SIZE > 0
+    case TK_FOR:
+      stmt = stmt_slot(tb, index, &local);
+      if (!stmt_decoded(stmt, index) && decode_for(tb, index, stmt))
+        return true;
+      return expr_check(tb, stmt->expr_index[0], stmt->expr_length[0]) ||
+        expr_check(tb, stmt->expr_index[1], stmt->expr_length[1]) ||
+        (stmt->expr_index[2] && expr_check(tb, stmt->expr_index[2], stmt->expr_length[2]));
+
+    case TK_NEXT:
+    case TK_RETURN:
+    #endif
+    #if POKE_PEEK == 1
+    case TK_POKE:
+    case TK_PEEK:
+    case TK_POKEB:
+    case TK_PEEKB:
+    #endif
+    #if ARRAYS == 1
+    case TK_DIM:
+    #endif
+    #if STATS == 1
+    case TK_STATS:
+    #endif
+    case TK_CHAR:
+    case TK_INPUT:
+    case TK_REM:
+    case TK_CLEAR:
+    case TK_END:
+      return false;
+
+    case TK_RUN:
+    case TK_LIST:
+    case TK_NEW:
+    case TK_MEMORY:
+    #if PROFILE == 1
+    case TK_PROFILE:
+    #endif
+    #if FILE_IO == 1
+    case TK_SAVE:
+    case TK_BSAVE:
+    case TK_LOAD:
+    #endif
+      print_error(tb, str_err_run_mode, index);
+      return true;
+
+    default:
+      if (isalpha(tb->codemem[index]) && (tb->codemem[index + 1] == ' ' || tb->codemem[index + 1] == '=' ||
+          (ARRAYS == 1 && tb->codemem[index + 1] == '(')))
+        goto analyze_let;
+      print_error(tb, str_err_unknown, index);
+      return true;
+  }
+}
+
+/**
+ * Check every line, resolve the jumps and fill the caches before the run, return true on the first error
+ */
+bool analyze_program(Interpreter *tb)
+{
+  bool failed = false;
+  size_t line = 0, slot = 0;
+  for (; line < tb->codemem_end && !failed; line += strlen(&tb->codemem[line + sizeof(line_t)]) + sizeof(line_t) + 1, slot++) {
+    #if LINE_INDEX == 1
+    tb->line_index[slot].jump = NO_JUMP;
+    #endif
+    tb->current_line = load_line_t(tb, line);
+    failed = analyze_command(tb, line + sizeof(line_t), slot);
+  }
+  tb->current_line = 0;
+  tb->program_checked = !failed;
+  return failed;
+}
+#endif
+
+/**
+ * Start the program execution
+ */
+void handle_run(Interpreter *tb)
+{
+  if (run_start(tb))
+    return;
+
+  // The clock is checked between the slices
+  #if RUN_LIMITS == 1
+  const unsigned long lines = (tb->time_limit) ? LIMIT_SLICE : ULONG_MAX;
+  #else
+  const unsigned long lines = ULONG_MAX;
+  #endif
+  while (run_slice(tb, lines));
+}
+
+/**
+ * Prepare the program to run from the first line, return true if it can't be started
+ */
+bool run_start(Interpreter *tb)
+{
+  // Skip if no code exists
+  if (!tb->codemem_end) {
+    print_string(tb, str_err_run_no_code);
+    print_string(tb, str_lf);
+    return true;
+  }
+
+  // Check the program before starting, once after every change of the code
+  #if RUN_ANALYZER == 1
+  if (!tb->program_checked && analyze_program(tb))
+    return true;
+  #else
+  if (resolve_jumps(tb))
+    return true;
+  #endif
+  #if ARRAYS == 1
+  array_clear(tb);
+  #endif
+
+  #if PROFILE == 1
+  for (size_t i = 0; i < tb->line_count; i++)
+    tb->line_index[i].hits = tb->line_index[i].ticks = 0;
+  #endif
+  #if CONTROL_STACK_SIZE > 0
+  tb->control_depth = 0;
+  tb->control_resume = NULL;
+  #endif
+  #if IO_KILL == 1
+  tb->break_request = false;
+  #if IO_KILL_INTERVAL > 0
+  tb->kill_countdown = IO_KILL_INTERVAL;
+  #endif
+  #endif
+  #if RUN_LIMITS == 1
+  tb->run_lines = tb->line_limit;
+  tb->run_clock = RUN_CLOCK();
+  #endif
+  tb->run_index = sizeof(line_t);
+  #if LINE_INDEX == 1
+  tb->run_slot = 0;
+  #endif
+  return false;
+}
+
+/**
+ * Run the started program for up to the given number of lines, return true if it's left in the middle
+ */
+bool run_slice(Interpreter *tb, unsigned long lines)
+{
+  #if LINE_INDEX == 1
+  size_t slot = tb->run_slot;
+  #endif
+  #if PROFILE == 1
+  LineIndex *profile_line;
+  unsigned long ticks;
+  #endif
+  #if RUN_THREADED == 1
+  Statement local;
+  Statement *stmt;
+  bool error;
+  var_t expr_value;
+  #endif
+  #if CONTROL_STACK_SIZE > 0
+  ControlFrame *resume;
+  #endif
+  #if RUN_COMPUTED_GOTO == 1
+  // Statement labels by the keyword token, the last one is for the lines without a keyword
+  void *run_table[KEYWORD_COUNT + 1];
+  for (size_t i = 0; i < KEYWORD_COUNT; i++)
+    run_table[i] = &&run_command;
+  run_table[TK_LET - TK_CLEAR] = &&run_let;
+  run_table[TK_PRINT - TK_CLEAR] = &&run_print;
+  run_table[TK_IF - TK_CLEAR] = &&run_if;
+  run_table[TK_GOTO - TK_CLEAR] = &&run_goto;
+  run_table[TK_REM - TK_CLEAR] = &&run_next;
+  run_table[TK_END - TK_CLEAR] = &&run_stop;
+  #if CONTROL_STACK_SIZE > 0
+  run_table[TK_FOR - TK_CLEAR] = &&run_for;
+  run_table[TK_NEXT - TK_CLEAR] = &&run_loop;
+  run_table[TK_GOSUB - TK_CLEAR] = &&run_gosub;
+  run_table[TK_RETURN - TK_CLEAR] = &&run_return;
+  #endif
+  run_table[KEYWORD_COUNT] = &&run_other;
+  #endif
+  #if IO_KILL == 1 && IO_KILL_INTERVAL > 0
+  unsigned int kill_countdown = tb->kill_countdown;
+  #endif
+  #if RUN_LIMITS == 1
+  // The slice ends early at the line limit
+  if (tb->line_limit && lines > tb->run_lines)
+    lines = tb->run_lines;
+  const unsigned long slice = lines;
+  #endif
+  line_t nextline;
+  size_t index = tb->run_index;
+
+  #if STEP_API == 1
+  // The 'INPUT' waiting for its value continues where it stopped (after 'THEN' too), the line isn't counted again
+  if (tb->step_state == STEP_INPUT_DONE) {
+    tb->current_line = tb->input_linenum;
+    #if PROFILE == 1
+    profile_line = &tb->line_index[slot];
+    ticks = PROFILE_TICKS();
+    #endif
+    goto run_input;
+  }
+  #endif
+
+run_line:
+  if (!lines)
+    goto run_suspend;
+  lines--;
+  tb->current_line = load_line_t(tb, index - sizeof(line_t));
+  BENCH_COUNT(lines);
+  STATS_ADD(ST_STATEMENTS, 1);
+
+  #if IO_KILL == 1
+  // Every jump and loop comes through here, so even a line running itself gets stopped
+  #if IO_KILL_INTERVAL > 0
+  if (!--kill_countdown) {
+    kill_countdown = IO_KILL_INTERVAL;
+    if (tb->io.check(tb->io.user)) {
+      char unused;  //NOLINT
+      INPUT_CHAR(&unused);
+      goto run_end;
+    }
+  }
+  #endif
+  if (tb->break_request) {
+    tb->break_request = false;
+    goto run_end;
+  }
+  #endif
+
+  // Execute a line
+  #if PROFILE == 1
+  profile_line = &tb->line_index[slot];
+  ticks = PROFILE_TICKS();
+  #endif
+
+  #if RUN_THREADED == 1
+run_dispatch:
+  #if RUN_COMPUTED_GOTO == 1
+  {
+    const uint8_t op = (uint8_t)tb->codemem[index] - TK_CLEAR;
+    goto *run_table[(op < KEYWORD_COUNT) ? op : KEYWORD_COUNT];
+  }
+  #endif
+  switch ((uint8_t)tb->codemem[index]) {
+
+    // Solve the expression and assign the value
+    case TK_LET:
+    RUN_LABEL(run_let)
+      index++;
+    run_assign:
+      stmt = stmt_slot(tb, index, &local);
+      if (!stmt_decoded(stmt, index) && decode_let(tb, index, stmt))
+        goto run_stop;
+      expr_value = stmt_value(tb, stmt, 0, &error);
+      if (error)
+        goto run_stop;
+      #if ARRAYS == 1
+      if (stmt->variable & VARIABLE_ARRAY) {
+        if (array_assign(tb, stmt, expr_value))
+          goto run_stop;
+        goto run_next;
+      }
+      #endif
+      tb->variables[stmt->variable] = expr_value;
+      goto run_next;
+
+    case TK_PRINT:
+    RUN_LABEL(run_print)
+      if (handle_print(tb, index) == MAX_LINENUM)
+        goto run_stop;
+      goto run_next;
+
+    // Check the condition and dispatch the command after 'THEN' if it's met
+    case TK_IF:
+    RUN_LABEL(run_if)
+      stmt = stmt_slot(tb, index, &local);
+      if (!stmt_decoded(stmt, index) && decode_if(tb, index, stmt))
+        goto run_stop;
+      expr_value = stmt_value(tb, stmt, 0, &error);
+      if (error)
+        goto run_stop;
+      {
+        const var_t expr_right_value = stmt_value(tb, stmt, 1, &error);
+        if (error)
+          goto run_stop;
+        if (!compare_values(stmt->compare, expr_value, expr_right_value))
+          goto run_next;
+      }
+      STATS_ADD(ST_STATEMENTS, 1);
+      #if STMT_FUSION == 1
+      if (stmt->jump != NO_JUMP)
+        goto run_branch;
+      #endif
+      index = stmt->next;
+      goto run_dispatch;
+
+    case TK_GOTO:
+    RUN_LABEL(run_goto)
+      stmt = stmt_slot(tb, index, &local);
+      if (!stmt_decoded(stmt, index) && decode_goto(tb, index, stmt))
+        goto run_stop;
+      nextline = stmt->target;
+      goto run_jump;
+
+    #if CONTROL_STACK_SIZE > 0
+    // Start the loop, the frame continues after this line
+    case TK_FOR:
+    RUN_LABEL(run_for)
+      if (control_for(tb, index, RUN_POSITION(index, slot)))
+        goto run_stop;
+      goto run_next;
+
+    // Step the loop and go back to its start if it's not done
+    case TK_NEXT:
+    RUN_LABEL(run_loop)
+      if (control_next(tb, index, &resume))
+        goto run_stop;
+      if (resume)
+        goto run_resume;
+      goto run_next;
+
+    case TK_GOSUB:
+    RUN_LABEL(run_gosub)
+      stmt = stmt_slot(tb, index, &local);
+      if (!stmt_decoded(stmt, index) && decode_goto(tb, index, stmt))
+        goto run_stop;
+      if (control_gosub(tb, index, RUN_POSITION(index, slot)))
+        goto run_stop;
+      nextline = stmt->target;
+      goto run_jump;
+
+    case TK_RETURN:
+    RUN_LABEL(run_return)
+      if (control_return(tb, index, &resume))
+        goto run_stop;
+      goto run_resume;
+    #endif
+
+    case TK_REM:
+      goto run_next;
+
+    case TK_END:
+      goto run_stop;
+
+    // Execute "LET" without the keyword, other commands are left to execute_command()
+    default:
+    RUN_LABEL(run_other)
+      if (isalpha(tb->codemem[index]) && (tb->codemem[index + 1] == ' ' || tb->codemem[index + 1] == '=' ||
+          (ARRAYS == 1 && tb->codemem[index + 1] == '(')))
+        goto run_assign;
+      break;
+  }
+  #endif
+
+RUN_LABEL(run_command)
+  #if STEP_API == 1
+run_input:
+  #endif
+  nextline = execute_command(tb, index);
+  if (nextline == MAX_LINENUM) {
+    #if CONTROL_STACK_SIZE > 0
+    resume = tb->control_resume;
+    tb->control_resume = NULL;
+    if (resume)
+      goto run_resume;
+    #endif
+    #if STEP_API == 1
+    if (tb->step_state == STEP_INPUT)
+      goto run_suspend;
+    #endif
+    goto run_stop;
+  } else if (nextline) {
+    goto run_jump;
+  } else {
+    goto run_next;
+  }
+
+  #if CONTROL_STACK_SIZE > 0
+  // Continue after the line from the control frame
+run_resume:
+  #if PROFILE == 1
+  profile_line_end(profile_line, ticks);
+  #endif
+  BENCH_COUNT(jumps);
+  #if LINE_INDEX == 1
+  slot = resume->position;
+  #else
+  index = resume->position;
+  #endif
+  goto run_advance;
+  #endif
+
+  // Find the next line index
+run_next:
+  #if PROFILE == 1
+  profile_line_end(profile_line, ticks);
+  #endif
+  #if CONTROL_STACK_SIZE > 0
+run_advance:
+  #endif
+  #if LINE_INDEX == 1
+  if (++slot >= tb->line_count)
+    goto run_end;
+  index = tb->line_index[slot].index + sizeof(line_t);
+  #else
+  index += strlen(&tb->codemem[index]) + sizeof(line_t) + 1;
+  if (index >= tb->codemem_end)
+    goto run_end;
+  #endif
+  goto run_line;
+
+  #if RUN_THREADED == 1 && STMT_FUSION == 1
+  // Jump to the line of the fused 'IF ... THEN GOTO'
+run_branch:
+  #if PROFILE == 1
+  profile_line_end(profile_line, ticks);
+  #endif
+  BENCH_COUNT(jumps);
+  STATS_ADD(ST_FUSED, 1);
+  #if LINE_INDEX == 1
+  slot = stmt->jump;
+  index = tb->line_index[slot].index + sizeof(line_t);
+  #else
+  index = stmt->jump;
+  #endif
+  goto run_line;
+  #endif
+
+  // Jump to the resolved line, or find it based on the line number
+run_jump:
+  #if PROFILE == 1
+  profile_line_end(profile_line, ticks);
+  #endif
+  BENCH_COUNT(jumps);
+  #if LINE_INDEX == 1
+  {
+    const size_t jump = tb->line_index[slot].jump;
+    slot = (jump != NO_JUMP && tb->line_index[jump].linenum == nextline) ?
+      jump : line_index_find(tb, nextline);
+    index = (slot < tb->line_count && tb->line_index[slot].linenum == nextline) ?
+      tb->line_index[slot].index + sizeof(line_t) : tb->codemem_end;
+  }
+  #else
+  index = get_line_index(tb, nextline);
+  #endif
+  if (index < tb->codemem_end)
+    goto run_line;
+  print_string(tb, str_err_line_not_found1);
+  print_unsigned(tb, nextline);
+  print_string(tb, str_err_line_not_found2);
+  print_string(tb, str_lf);
+  tb->error_reported = true;
+  goto run_end;
+
+  // Exit on 'END' or if error occured
+run_stop:
+  #if PROFILE == 1
+  profile_line_end(profile_line, ticks);
+  #endif
+run_end:
+  tb->current_line = 0;
+  return false;
+
+  // Keep the position of the line to continue at
+run_suspend:
+  tb->run_index = index;
+  #if STEP_API == 1
+  if (tb->step_state == STEP_INPUT)
+    tb->input_linenum = tb->current_line;
+  #endif
+  #if LINE_INDEX == 1
+  tb->run_slot = slot;
+  #endif
+  #if IO_KILL == 1 && IO_KILL_INTERVAL > 0
+  tb->kill_countdown = kill_countdown;
+  #endif
+  #if RUN_LIMITS == 1
+  tb->run_lines -= slice - lines;
+  #if STEP_API == 1
+  if (tb->step_state == STEP_INPUT)
+    return true;
+  #endif
+
+  // Stop the program at the line it would continue with if it ran out of the limits
+  {
+    const char *limit = NULL;
+    if (tb->line_limit && !tb->run_lines)
+      limit = str_err_line_limit;
+    else if (tb->time_limit && RUN_CLOCK() - tb->run_clock >= tb->time_limit)
+      limit = str_err_time_limit;
+    if (limit) {
+      tb->current_line = load_line_t(tb, index - sizeof(line_t));
+      print_error(tb, limit, index);
+      tb->current_line = 0;
+      return false;
+    }
+  }
+  #endif
+  return true;
+}
+
+/****************************************************************************/
+
+/**
+ * Execute the "newline command" (or store in tb->codemem if needed)
+ */
+void execute_newline(Interpreter *tb)
+{
+  // Terminate the line and skip starting spaces and tabs
+  tb->codemem[tb->newline_end] = '\0';
+  size_t index = tb->newline_ind;
+  skip_spaces(tb, &index);
+  if (index == tb->newline_end)
+    return;
+
+  // Check if the command starts with linenumber
+  if (isdigit(tb->codemem[index])) {
+    store_newline(tb, index);
+  } else {
+    #if GAP_BUFFER == 1
+    // Commands see the whole program in one piece
+    const size_t offset = index - tb->newline_ind;
+    gap_close(tb);
+    index = tb->newline_ind + offset;
+    #endif
+    tb->newline_end = tokenize_line(tb, index, tb->newline_end);
+    tb->codemem[tb->newline_end] = '\0';
+    execute_command(tb, index);
+  }
+
+  // "Clear" the newline buffer
+  tb->newline_ind = tb->codemem_end;
+  tb->newline_end = tb->codemem_end;
+}
+
+/**
+ * Handle the shell input, return true if command has to be ran
+ */
+bool handle_shell(Interpreter *tb)
+{
+  char chr;
+  INPUT_CHAR(&chr);
+  return edit_line(tb, tb->newline_ind, &tb->newline_end, chr);
+}
+
+#if INPUT_BUFFER_SIZE > 0
+/**
+ * Put the next input line in the shell line, return false at the end of the input
+ */
+bool shell_line(Interpreter *tb)
+{
+  const char *line;
+  size_t length;
+  bool complete;
+  if (!input_line(tb, &line, &length, &complete))
+    return false;
+  input_copy(tb, line, length, complete, tb->newline_ind, &tb->newline_end);
+  return true;
+}
+#endif
+
+#if STEP_API == 1
+/**
+ * Take a received character, return false if it has to be kept until tb_step() gets the interpreter waiting for it
+ */
+bool tb_feed_char(Interpreter *tb, char chr)
+{
+  switch (tb->step_state) {
+    case STEP_SHELL:
+      if (edit_line(tb, tb->newline_ind, &tb->newline_end, chr))
+        tb->step_state = STEP_LINE;
+      break;
+
+    case STEP_CONFIRM:
+      confirm_new(tb, chr);
+      tb->step_state = STEP_SHELL;
+      print_string(tb, str_shell_prompt);
+      break;
 
-    if (chr == BACKSPACE) {
-      if (expr_length) {
-        expr_length--;
-        #if LOOPBACK == 1
-        print_string(str_bs);
-        #endif
-      }
+    case STEP_INPUT: {
+      size_t expr_end = tb->newline_end + tb->input_length;
+      if (edit_line(tb, tb->newline_end, &expr_end, chr))
+        tb->step_state = STEP_INPUT_DONE;
+      tb->input_length = expr_end - tb->newline_end;
+      break;
     }
 
-    else if (chr == NEWLINE) {
-      #if LOOPBACK == 1
-      print_string(str_lf);
-      #endif
+    #if IO_KILL == 1
+    // Any character stops the running program
+    case STEP_RUN:
+      interpreter_break(tb);
       break;
-    }
+    #endif
 
-    else if (newline_end + expr_length < CODE_MEMORY_SIZE) {
-      codemem[newline_end + expr_length++] = chr;
-      #if LOOPBACK == 1
-      PUTCHAR(&chr);
-      #endif
-    }
+    default:
+      return false;
   }
-  codemem[newline_end + expr_length] = '\0';
-
-  bool error;
-  var_t expr_value = expr_solve(newline_end, expr_length, &error);
-  if (error)
-    return MAX_LINENUM;
 
-  variables[variable] = expr_value;
-  return 0;
+  #if OUTPUT_BUFFER_SIZE > 0 && OUTPUT_IRQ == 0
+  output_flush(tb);
+  #endif
+  return true;
 }
 
-#if POKE_PEEK == 1
 /**
- * Poke in memory, change some values
+ * Execute the waiting shell line or up to the given number of program lines, return false if it waits for input
  */
-line_t handle_poke(size_t index, bool byte_size)
+bool tb_step(Interpreter *tb, unsigned long lines)
 {
-  bool error;
-  const size_t initial_index = index;
-  index += (byte_size) ? strlen(kwd_peekb) : strlen(kwd_peek);
-  skip_spaces(&index);
-
-  // Get the first expression
-  size_t length = 0;
-  while (codemem[index + length] != '\0' && codemem[index + length] != ',')
-    length++;
-  if (codemem[index + length] == '\0')
-    return print_error(str_err_poke_exprs, initial_index);
-  size_t address = expr_solve(index, length, &error);
-  if (error)
-    return MAX_LINENUM;
-
-  // Get the second expression
-  index += length + 1;
-  length = 0;
-  while (codemem[index + length] != '\0')
-    length++;
-  peek_t value = expr_solve(index, length, &error);
-  if (error)
-    return MAX_LINENUM;
+  switch (tb->step_state) {
+    // 'RUN' only starts the program, the other commands are done at once
+    case STEP_LINE:
+      execute_newline(tb);
+      if (tb->step_state != STEP_LINE)
+        break;
+      tb->step_state = STEP_SHELL;
+      print_string(tb, str_shell_prompt);
+      break;
 
-  // Do the memory operation
-  if (byte_size) {
-    *(uint8_t*)(address) = (uint8_t)value;
-  } else {
-    *(peek_t*)(address) = (peek_t)value;
+    case STEP_RUN:
+    case STEP_INPUT_DONE:
+      if (run_slice(tb, lines))
+        break;
+      tb->step_state = STEP_SHELL;
+      print_string(tb, str_shell_prompt);
+      break;
   }
 
-  return 0;
+  const bool busy = tb->step_state == STEP_LINE || tb->step_state == STEP_RUN || tb->step_state == STEP_INPUT_DONE;
+  #if OUTPUT_BUFFER_SIZE > 0 && OUTPUT_IRQ == 0
+  if (!busy)
+    output_flush(tb);
+  #endif
+  return busy;
 }
+#endif
+
+/****************************************************************************/
 
+#if BENCH == 1
 /**
- * Peek into the memory, get some values
+ * Count a character sent by the benchmarked program
  */
-line_t handle_peek(size_t index, bool byte_size)
+void bench_put(void *user, char chr)
 {
-  bool error;
-  const size_t initial_index = index;
-  index += (byte_size) ? strlen(kwd_pokeb) : strlen(kwd_poke);
-  skip_spaces(&index);
+  (void)chr;
+  ((Interpreter *)user)->bench_output++;
+}
 
-  // Get the first expression
-  size_t length = 0;
-  while (codemem[index + length] != '\0' && codemem[index + length] != ',')
-    length++;
-  if (codemem[index + length] == '\0')
-    return print_error(str_err_peek_exprs, initial_index);
-  size_t address = expr_solve(index, length, &error);
-  if (error)
-    return MAX_LINENUM;
+/**
+ * Answer every input with an empty line
+ */
+char bench_get(void *user)
+{
+  (void)user;
+  return NEWLINE;
+}
 
-  // Get the variable target
-  index += length + 1;
-  skip_spaces(&index);
-  if (!isalpha(codemem[index]) || codemem[index + 1] != '\0')
-    return print_error(str_err_peek_target, initial_index);
-  size_t variable = toupper(codemem[index]) - 'A';
+/**
+ * Never break the benchmarked program
+ */
+bool bench_check(void *user)
+{
+  (void)user;
+  return false;
+}
 
-  // Do the memory operation
-  variables[variable] = (byte_size) ?
-    (var_t)(*(uint8_t*)(address)) : (var_t)(*(peek_t*)(address));
-  return 0;
+/**
+ * Count a block of characters sent by the benchmarked program
+ */
+void bench_flush(void *user, const char *buffer, size_t length)
+{
+  (void)buffer;
+  ((Interpreter *)user)->bench_output += length;
 }
-#endif
 
-#if FILE_IO == 1
 /**
- * Save the memory contents to a file
+ * Answer every input line with an empty one
  */
-void handle_save(size_t index)
+size_t bench_read(void *user, char *buffer, size_t size)
 {
-  // Get the file name
-  const size_t initial_index = index;
-  index += strlen(kwd_save);
-  skip_spaces(&index);
+  (void)user;
+  (void)size;
+  buffer[0] = NEWLINE;
+  return 1;
+}
 
-  // Check if the code exists
-  if (codemem_end == 0) {
-    print_error(str_err_save_no_code, initial_index);
-    return;
-  }
+/**
+ * Run each program from the command line for a while and show the statistics
+ */
+int main(int argc, char **argv)
+{
+  static Interpreter bench;
+  Interpreter *tb = &bench;
+  const InterpreterIO io = { bench_put, bench_get, bench_check, bench_flush, bench_read, tb };
+  interpreter_init(tb, &io);
+
+  for (int arg = 1; arg < argc; arg++) {
+    clear_code(tb);
+    if (load_file(tb, argv[arg])) {
+      fprintf(stderr, "Failed to open %s\n", argv[arg]);
+      return 1;
+    }
 
-  // Open a file
-  const char *filename = &codemem[index];
-  FILE *file = fopen(filename, "w");
-  if (ferror(file)) {
-    print_error(str_err_save_file, initial_index);
-    fclose(file);
-    return;
+    // Run the program until enough time passes
+    tb->bench_lines = tb->bench_exprs = tb->bench_jumps = tb->bench_errors = tb->bench_output = 0;
+    unsigned long runs = 0;
+    const clock_t start = clock();
+    clock_t elapsed;
+    do {
+      handle_run(tb);
+      #if OUTPUT_BUFFER_SIZE > 0
+      output_flush(tb);
+      #endif
+      runs++;
+      elapsed = clock() - start;
+    } while (elapsed < BENCH_TIME);
+
+    const double seconds = (double)elapsed / CLOCKS_PER_SEC;
+    printf("%-24s %6lu runs %7.3f s %12.0f lines/s %12.0f evals/s %12.0f jumps/s%s\n",
+      argv[arg], runs, seconds, tb->bench_lines / seconds, tb->bench_exprs / seconds,
+      tb->bench_jumps / seconds, (tb->bench_errors) ? " (errors)" : "");
   }
 
-  // Write to the file
-  size_t mem_index = sizeof(line_t);
-  while (mem_index < codemem_end) {
-    fprintf(file, "%d %s\n", load_line_t(mem_index - sizeof(line_t)), &codemem[mem_index]);
-    mem_index += strlen(&codemem[mem_index]) + sizeof(line_t) + 1;
-  }
+  return 0;
+}
+#elif FUZZ == 1
+// Variables read by the expressions, the statements only assign the first FUZZ_TARGETS (the rest are loop counters)
+static const char fuzz_variables[] = "ABCDEFIJK";
+#define FUZZ_TARGETS      6
 
-  // Close the file
-  fclose(file);
+/**
+ * Add the character to the FNV-1a hash
+ */
+static inline void fuzz_hash(uint32_t *hash, char chr)
+{
+  *hash = (*hash ^ (uint8_t)chr) * 16777619u;
 }
 
 /**
- * Load the memory contents from a file
+ * Hash a character sent by the fuzzed program
  */
-void handle_load(size_t index)
+void fuzz_put(void *user, char chr)
 {
-  const size_t initial_index = index;
-  index += strlen(kwd_load);
-  skip_spaces(&index);
-
-  // Get the file contents
-  const char *filename = &codemem[index];
-  FILE *file = fopen(filename, "r");
-  if (ferror(file)) {
-    print_error(str_err_load_file, initial_index);
-    fclose(file);
-    return;
-  }
-  fseek(file, 0, SEEK_END);
-  const size_t length = ftell(file) + 1;
-  char *file_contents = (char*)malloc(length * sizeof(char));
-  fseek(file, 0, SEEK_SET);
-  fread(file_contents, sizeof(char), length, file);
-  fclose(file);
+  fuzz_hash(&((Interpreter *)user)->fuzz_hash, chr);
+}
 
-  // Load the lines to the memory in a hacky way (copy to new line buffer and execute)
-  size_t file_index = 0;
-  while (file_index < length) {
+/**
+ * Answer every input with an empty line
+ */
+char fuzz_get(void *user)
+{
+  (void)user;
+  return NEWLINE;
+}
 
-    // Get the line length
-    size_t line_length = 0;
-    while (line_length < length && file_contents[file_index + line_length] != '\n')
-      line_length++;
+/**
+ * Never break the fuzzed program
+ */
+bool fuzz_check(void *user)
+{
+  (void)user;
+  return false;
+}
 
-    // Skip if line doesn't seem to be valid
-    if (!isdigit(file_contents[file_index])) {
-      file_index += line_length + 1;
-      continue;
-    }
+/**
+ * Hash a block of characters sent by the fuzzed program
+ */
+void fuzz_flush(void *user, const char *buffer, size_t length)
+{
+  for (size_t i = 0; i < length; i++)
+    fuzz_hash(&((Interpreter *)user)->fuzz_hash, buffer[i]);
+}
 
-    // Copy the line and set the pointers
-    newline_end = newline_ind + line_length;
-    for (size_t i = 0; i < line_length; i++)
-      codemem[newline_ind + i] = file_contents[file_index + i];
-    codemem[newline_ind + line_length] = '\0';
+/**
+ * Answer every input line with an empty one
+ */
+size_t fuzz_read(void *user, char *buffer, size_t size)
+{
+  (void)user;
+  (void)size;
+  buffer[0] = NEWLINE;
+  return 1;
+}
 
-    // Execute the line
-    execute_newline();
-    file_index += line_length + 1;
-  }
+/**
+ * Get the next random number lower than the range (xorshift)
+ */
+uint32_t fuzz_random(FuzzProgram *program, uint32_t range)
+{
+  uint32_t x = program->state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  program->state = x;
+  return x % range;
+}
 
-  // Remember to dealloc your pointers
-  free(file_contents);
+/**
+ * Append the text to the program, it's cut off when there's no space left
+ */
+void fuzz_append(FuzzProgram *program, const char *text)
+{
+  while (*text && program->length + 1 < FUZZ_TEXT_SIZE)
+    program->text[program->length++] = *text++;
+  program->text[program->length] = '\0';
 }
-#endif
 
 /**
- * Ask for confirmation and if confirmed clear the memory
+ * Append the number as a decimal or a hex literal
  */
-void handle_new(void)
+void fuzz_number(FuzzProgram *program, unsigned long number, bool hex)
 {
-  print_string(str_new_confirm);
-  char chr;
-  GETCHAR(&chr);
-  if (toupper(chr) == 'Y') {
-    print_string(str_lf);
-    print_string(str_new_confirm_accept);
-    print_string(str_lf);
-    for (int i = 0; i < CODE_MEMORY_SIZE; i++)
-      codemem[i] = '\0';
-    codemem_end = 0;
-    newline_ind = 0;
-    newline_end = 0;
-  } else {
-    print_string(str_lf);
-  }
+  char buffer[NUMBER_BUFFER_SIZE];
+  snprintf(buffer, sizeof(buffer), (hex) ? "0x%lX" : "%lu", number);
+  fuzz_append(program, buffer);
 }
 
 /**
- * Start the program execution
+ * Append a random expression nested up to the depth, the unary operators only go before the values
+ * (the original solver doesn't take them before the brackets)
  */
-void handle_run(void)
+void fuzz_expr(FuzzProgram *program, unsigned int depth)
 {
-  // Skip if no code exists
-  if (!codemem_end) {
-    print_string(str_err_run_no_code);
-    print_string(str_lf);
-    return;
-  }
+  static const char *const unary[] = { "-", "!", "+" };
+  static const char *const binary[] = { " + ", " - ", " * ", " / ", " % ", " & ", " | ", " ^ ", "+", "-", "*" };
+  const uint32_t kind = fuzz_random(program, (depth) ? 8 : 3);
+  switch (kind) {
+
+    // Variable or number, sometimes with the unary operator
+    case 0:
+    case 1:
+    case 2:
+      if (!fuzz_random(program, 6))
+        fuzz_append(program, unary[fuzz_random(program, 3)]);
+      if (kind == 0) {
+        const char variable[2] = { fuzz_variables[fuzz_random(program, sizeof(fuzz_variables) - 1)], '\0' };
+        fuzz_append(program, variable);
+      } else {
+        fuzz_number(program, fuzz_random(program, (kind == 1) ? 10 : 100000), !fuzz_random(program, 8));
+      }
+      break;
 
-  size_t index = sizeof(line_t);
-  current_line = load_line_t(0);
-  while (1) {
+    case 3:
+      fuzz_append(program, "(");
+      fuzz_expr(program, depth - 1);
+      fuzz_append(program, ")");
+      break;
 
-    #if IO_KILL == 1
-    bool io_kill;
-    IO_CHECK(&io_kill);
-    if (io_kill) {
-      char unused;  //NOLINT
-      GETCHAR(&unused);
+    // Binary operation, dividing mostly by the non-zero numbers
+    default: {
+      const uint32_t op = fuzz_random(program, sizeof(binary) / sizeof(binary[0]));
+      fuzz_expr(program, depth - 1);
+      fuzz_append(program, binary[op]);
+      if ((op == 3 || op == 4) && fuzz_random(program, 8))
+        fuzz_number(program, 1 + fuzz_random(program, 9), false);
+      else
+        fuzz_expr(program, depth - 1);
       break;
     }
-    #endif
+  }
+}
+
+/**
+ * Append a random statement that doesn't jump, the line number is already there
+ */
+void fuzz_statement(FuzzProgram *program)
+{
+  static const char *const compares[] = { " < ", " > ", " = ", " <> ", "<", "=" };
+  const char target[2] = { fuzz_variables[fuzz_random(program, FUZZ_TARGETS)], '\0' };
+  switch (fuzz_random(program, 7)) {
+    case 0:
+      fuzz_append(program, "LET ");
+      // fall through
+    case 1:
+      fuzz_append(program, target);
+      fuzz_append(program, " = ");
+      fuzz_expr(program, 3);
+      break;
 
-    // Execute a line
-    line_t nextline = execute_command(index);
-    current_line = nextline;
+    // The increment the fusion looks for
+    case 2:
+      fuzz_append(program, target);
+      fuzz_append(program, " = ");
+      fuzz_append(program, target);
+      fuzz_append(program, (fuzz_random(program, 2)) ? " + " : " - ");
+      fuzz_number(program, 1 + fuzz_random(program, 100), false);
+      break;
 
-    // Exit if error occured
-    if (nextline == MAX_LINENUM) {
+    case 3:
+      fuzz_append(program, "PRINT ");
+      if (!fuzz_random(program, 3))
+        fuzz_append(program, "\"V\" : ");
+      fuzz_expr(program, 3);
+      if (!fuzz_random(program, 4))
+        fuzz_append(program, " :");
       break;
-    }
 
-    // Find the next line index if not given
-    else if (!nextline) {
-      index += strlen(&codemem[index]) + sizeof(line_t) + 1;
-      if (index >= codemem_end)
+    // Condition with an assignment or a print
+    default:
+      fuzz_append(program, "IF ");
+      fuzz_expr(program, 2);
+      fuzz_append(program, compares[fuzz_random(program, sizeof(compares) / sizeof(compares[0]))]);
+      fuzz_expr(program, 2);
+      fuzz_append(program, " THEN ");
+      if (fuzz_random(program, 2)) {
+        fuzz_append(program, target);
+        fuzz_append(program, " = ");
+        fuzz_expr(program, 2);
+      } else {
+        fuzz_append(program, "PRINT ");
+        fuzz_expr(program, 2);
+      }
+      break;
+  }
+  fuzz_append(program, "\n");
+}
+
+/**
+ * Generate the program of the case from blocks of statements, counted loops, 'FOR' loops and forward jumps
+ */
+void fuzz_generate(FuzzProgram *program, uint32_t seed)
+{
+  program->state = (seed * 2654435761u) | 1;
+  program->length = 0;
+  program->text[0] = '\0';
+
+  // Every block starts at a hundred, so the jumps can go to any later one
+  const uint32_t blocks = 4 + fuzz_random(program, 12);
+  for (uint32_t block = 1; block <= blocks; block++) {
+    const unsigned long line = block * 100;
+    const char counter[2] = { fuzz_variables[FUZZ_TARGETS + fuzz_random(program, 3)], '\0' };
+    const uint32_t body = 1 + fuzz_random(program, 3);
+    fuzz_number(program, line, false);
+    fuzz_append(program, " ");
+
+    switch (fuzz_random(program, 8)) {
+      // Jump forward, mostly on a condition
+      case 0:
+        if (fuzz_random(program, 4)) {
+          fuzz_append(program, "IF ");
+          fuzz_expr(program, 2);
+          fuzz_append(program, (fuzz_random(program, 2)) ? " < " : " > ");
+          fuzz_expr(program, 2);
+          fuzz_append(program, " THEN ");
+        }
+        fuzz_append(program, "GOTO ");
+        fuzz_number(program, (block + 1 + fuzz_random(program, blocks - block + 1)) * 100, false);
+        fuzz_append(program, "\n");
+        break;
+
+      // Counted loop the fusion looks for
+      case 1:
+        fuzz_append(program, counter);
+        fuzz_append(program, " = 0\n");
+        for (uint32_t i = 1; i <= body; i++) {
+          fuzz_number(program, line + i * 10, false);
+          fuzz_append(program, " ");
+          fuzz_statement(program);
+        }
+        fuzz_number(program, line + (body + 1) * 10, false);
+        fuzz_append(program, " ");
+        fuzz_append(program, counter);
+        fuzz_append(program, " = ");
+        fuzz_append(program, counter);
+        fuzz_append(program, " + 1\n");
+        fuzz_number(program, line + (body + 2) * 10, false);
+        fuzz_append(program, " IF ");
+        fuzz_append(program, counter);
+        fuzz_append(program, " < ");
+        fuzz_number(program, 1 + fuzz_random(program, 30), false);
+        fuzz_append(program, " THEN GOTO ");
+        fuzz_number(program, line + 10, false);
+        fuzz_append(program, "\n");
         break;
-    }
 
-    // Find the line index based on the line number
-    else {
-      index = get_line_index(nextline);
-      if (index == codemem_end) {
-        print_string(str_err_line_not_found1);
-        print_unsigned(nextline);
-        print_string(str_err_line_not_found2);
-        print_string(str_lf);
+      case 2: {
+        const uint32_t start = fuzz_random(program, 5);
+        fuzz_append(program, "FOR ");
+        fuzz_append(program, counter);
+        fuzz_append(program, " = ");
+        fuzz_number(program, start, false);
+        fuzz_append(program, " TO ");
+        fuzz_number(program, start + fuzz_random(program, 20), false);
+        if (!fuzz_random(program, 3)) {
+          fuzz_append(program, " STEP ");
+          fuzz_number(program, 1 + fuzz_random(program, 3), false);
+        }
+        fuzz_append(program, "\n");
+        for (uint32_t i = 1; i <= body; i++) {
+          fuzz_number(program, line + i * 10, false);
+          fuzz_append(program, " ");
+          fuzz_statement(program);
+        }
+        fuzz_number(program, line + (body + 1) * 10, false);
+        fuzz_append(program, " NEXT ");
+        fuzz_append(program, counter);
+        fuzz_append(program, "\n");
         break;
       }
+
+      default:
+        fuzz_statement(program);
+        break;
     }
   }
 
-  current_line = 0;
+  // The last jump target
+  fuzz_number(program, (blocks + 1) * 100, false);
+  fuzz_append(program, " END\n");
 }
 
-/****************************************************************************/
-
 /**
- * Execute the "newline command" (or store in codemem if needed)
+ * Put the program lines in the code memory as if they were typed
  */
-void execute_newline(void)
+void fuzz_load(Interpreter *tb, const FuzzProgram *program)
 {
-  // Skip starting spaces and tabs
-  size_t index = newline_ind;
-  skip_spaces(&index);
-  if (index == newline_end)
-    return;
-
-  // Check if the command starts with linenumber
-  if (isdigit(codemem[index])) {
-    store_newline(index);
-  } else {
-    codemem[newline_end] = '\0';
-    execute_command(newline_ind);
+  clear_code(tb);
+  const char *line = program->text;
+  const char *end;
+  while ((end = strchr(line, '\n'))) {
+    const size_t length = end - line;
+    memcpy(&tb->codemem[tb->newline_ind], line, length);
+    tb->newline_end = tb->newline_ind + length;
+    execute_newline(tb);
+    line = end + 1;
   }
+}
 
-  // "Clear" the newline buffer
-  newline_ind = codemem_end;
-  newline_end = codemem_end;
+/**
+ * Run the loaded program repeatedly in rounds for the time of a run
+ */
+double fuzz_time(Interpreter *tb)
+{
+  // Every timed run starts with the same variables, the fastest round is taken
+  double best = 0;
+  for (unsigned int round = 0; round < FUZZ_ROUNDS; round++) {
+    unsigned long runs = 0;
+    const clock_t start = clock();
+    clock_t elapsed;
+    do {
+      memset(tb->variables, 0, sizeof(tb->variables));
+      handle_run(tb);
+      #if OUTPUT_BUFFER_SIZE > 0
+      output_flush(tb);
+      #endif
+      runs++;
+      elapsed = clock() - start;
+    } while (elapsed < FUZZ_TIME);
+    const double ns = (double)elapsed * 1e9 / CLOCKS_PER_SEC / runs;
+    if (!round || ns < best)
+      best = ns;
+  }
+  return best;
 }
 
 /**
- * Handle the shell input, return true if command has to be ran
+ * Run the program once for the output and variables, then time it
  */
-bool handle_shell(void)
+void fuzz_case(Interpreter *tb, const FuzzProgram *program, FuzzResult *result)
 {
-  char chr;
-  GETCHAR(&chr);
+  fuzz_load(tb, program);
+  memset(tb->variables, 0, sizeof(tb->variables));
+  tb->fuzz_hash = 2166136261u;
+  handle_run(tb);
+  #if OUTPUT_BUFFER_SIZE > 0
+  output_flush(tb);
+  #endif
+  result->output = tb->fuzz_hash;
+  result->variables = 2166136261u;
+  for (size_t i = 0; i < sizeof(tb->variables); i++)
+    fuzz_hash(&result->variables, ((const char *)tb->variables)[i]);
 
-  // If it was backspace delete the character from the line
-  if (chr == BACKSPACE) {
-    if (newline_end > newline_ind) {
-      newline_end--;
-      #if LOOPBACK == 1
-      print_string(str_bs);
-      #endif
+  result->ns = fuzz_time(tb);
+}
+
+/**
+ * Run the cases from the seed: [-r reference] [-s percent] [-c percent] seed count, print the seed, output hash,
+ * variables hash and run time of every case, check them against the reference build results (the
+ * slower cases are timed again, the check fails when more than FUZZ_SLOW_CASES percent stay slower)
+ */
+int main(int argc, char **argv)
+{
+  static Interpreter fuzz;
+  static FuzzProgram program;
+  Interpreter *tb = &fuzz;
+  const InterpreterIO io = { fuzz_put, fuzz_get, fuzz_check, fuzz_flush, fuzz_read, tb };
+  interpreter_init(tb, &io);
+
+  FILE *reference = NULL;
+  unsigned long slowdown = FUZZ_SLOWDOWN;
+  unsigned long case_slowdown = FUZZ_CASE_SLOWDOWN;
+  int arg = 1;
+  for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+    if (!strcmp(argv[arg], "-r")) {
+      reference = fopen(argv[arg + 1], "r");
+      if (!reference) {
+        fprintf(stderr, "Failed to open %s\n", argv[arg + 1]);
+        return 2;
+      }
+    } else if (!strcmp(argv[arg], "-s")) {
+      slowdown = strtoul(argv[arg + 1], NULL, 10);
+    } else if (!strcmp(argv[arg], "-c")) {
+      case_slowdown = strtoul(argv[arg + 1], NULL, 10);
+    } else {
+      break;
     }
-    return false;
   }
-
-  // If it was line feed execute the line
-  else if (chr == NEWLINE) {
-    #if LOOPBACK == 1
-    print_string(str_lf);
-    #endif
-    return true;
+  if (arg + 2 != argc) {
+    fprintf(stderr, "Usage: %s [-r reference] [-s percent] [-c percent] seed count\n", argv[0]);
+    return 2;
   }
+  const unsigned long seed = strtoul(argv[arg], NULL, 10);
+  const unsigned long count = strtoul(argv[arg + 1], NULL, 10);
+
+  unsigned long diverged = 0, slower = 0;
+  double total = 0, reference_total = 0;
+  for (unsigned long i = seed; i < seed + count; i++) {
+    FuzzResult result;
+    fuzz_generate(&program, (uint32_t)i);
+    fuzz_case(tb, &program, &result);
+    if (!reference) {
+      printf("%lu %08lx %08lx %.0f\n", i, (unsigned long)result.output, (unsigned long)result.variables, result.ns);
+      total += result.ns;
+      continue;
+    }
 
-  // If it wasn't line feed add the character to the memory
-  else if (newline_end < CODE_MEMORY_SIZE) {
-    codemem[newline_end++] = chr;
-    #if LOOPBACK == 1
-    PUTCHAR(&chr);
-    #endif
-    return false;
+    // The same case has to do the same in the reference build, and not take much longer
+    unsigned long ref_case, ref_output, ref_variables;
+    double ref_ns;
+    if (fscanf(reference, "%lu %lx %lx %lf", &ref_case, &ref_output, &ref_variables, &ref_ns) != 4 || ref_case != i) {
+      fprintf(stderr, "Reference has no case %lu\n", i);
+      fclose(reference);
+      return 2;
+    }
+    reference_total += ref_ns;
+    if (ref_output != result.output || ref_variables != result.variables) {
+      diverged++;
+      fprintf(stderr, "Case %lu diverged (%s):\n%s", i,
+        (ref_output != result.output) ? "output" : "variables", program.text);
+    } else {
+      // A slower case is timed again, so a single hiccup doesn't count
+      for (unsigned int retime = 0; retime < FUZZ_RETIMES && result.ns * 100 > ref_ns * (100 + case_slowdown); retime++) {
+        const double ns = fuzz_time(tb);
+        if (ns < result.ns)
+          result.ns = ns;
+      }
+      if (result.ns * 100 > ref_ns * (100 + case_slowdown)) {
+        slower++;
+        fprintf(stderr, "Case %lu is slower: %.0f ns, %.0f ns in the reference\n", i, result.ns, ref_ns);
+      }
+    }
+    printf("%lu %08lx %08lx %.0f\n", i, (unsigned long)result.output, (unsigned long)result.variables, result.ns);
+    total += result.ns;
   }
+  fflush(stdout);
 
-  return false;
+  if (!reference)
+    return 0;
+  fclose(reference);
+  fprintf(stderr, "%lu cases, %lu diverged, %lu slower, %.0f ns against %.0f ns in the reference\n",
+    count, diverged, slower, total, reference_total);
+  const bool slow_total = total * 100 > reference_total * (100 + slowdown);
+  if (slow_total)
+    fprintf(stderr, "Total time is %.0f%% over the reference\n", total * 100 / reference_total - 100);
+  return (diverged || slow_total || slower * 100 > count * FUZZ_SLOW_CASES) ? 1 : 0;
 }
-
-/****************************************************************************/
-
+#else
+#if BATCH_MODE == 1
+int main(int argc, char **argv)
+#else
 int main(void)
+#endif
 {
-  // Initialize the IO
+  // Initialize the IO and the console interpreter
   IO_INIT();
+  static Interpreter console;
+  Interpreter *tb = &console;
+  interpreter_init(tb, NULL);
+
+  #if BATCH_MODE == 1
+  #if BATCH_THREADS > 0
+  // Options, several programs or a directory go to the batch runner
+  struct stat info;
+  if (argc > 2 || (argc > 1 && (argv[1][0] == '-' || (!stat(argv[1], &info) && S_ISDIR(info.st_mode)))))
+    return batch_main(argc, argv);
+  #endif
 
-  // Preset the static variables
-  codemem_end = 0;
-  newline_ind = 0;
-  newline_end = 0;
-  expr_token_count = 0;
-  current_line = 0;
-
-  for (int i = 0; i < 26; i++)
-    variables[i] = 0;
+  // Run the program given on the command line and exit, the counters go to stderr
+  if (argc > 1) {
+    const int result = run_file(tb, argv[1]);
+    #if STATS == 1
+    stats_json(stderr, tb->stats);
+    #endif
+    return result;
+  }
+  #endif
 
   // Show the prompt
-  print_string(str_motd);
-  print_string(str_lf);
-  print_string(str_shell_prompt);
+  print_string(tb, str_motd);
+  print_string(tb, str_lf);
+  print_string(tb, str_shell_prompt);
 
   // Main loop
+  #if STEP_API == 1
+  // Feed the received characters and run the interpreter by the slices in between
+  bool received = false;
+  bool busy = false;
+  char chr;
+  while (1) {
+    #if INPUT_BUFFER_SIZE > 0
+    // The characters are taken from the input buffer, it's only read when the interpreter waits, and the console
+    // exits at the end of the input
+    if (!received && (tb->input_head < tb->input_tail || (!busy && input_fill(tb)))) {
+      chr = tb->input_buffer[tb->input_head++];
+      received = true;
+    } else if (!received && !busy) {
+      break;
+    }
+    #else
+    if (!received) {
+      IO_CHECK(&received);
+      if (received)
+        GETCHAR(&chr);
+    }
+    #endif
+    if (received && tb_feed_char(tb, chr))
+      received = false;
+    busy = tb_step(tb, STEP_SLICE);
+    if (!busy && !received)
+      IDLE();
+  }
+  #if OUTPUT_BUFFER_SIZE > 0
+  output_flush(tb);
+  #endif
+  return 0;
+  #elif INPUT_BUFFER_SIZE > 0
+  // Execute the input line by line and exit at its end
+  while (shell_line(tb)) {
+    execute_newline(tb);
+    print_string(tb, str_shell_prompt);
+  }
+  #if OUTPUT_BUFFER_SIZE > 0
+  output_flush(tb);
+  #endif
+  return 0;
+  #else
   while (1) {
-    const bool execute = handle_shell();
+    const bool execute = handle_shell(tb);
 
     if (execute) {
-      execute_newline();
-      print_string(str_shell_prompt);
+      execute_newline(tb);
+      print_string(tb, str_shell_prompt);
     }
   }
+  #endif
 }
+#endif
@@ -0,0 +1,18 @@
+10 REM Arrays are separate from the variables and start with zeros
+20 DIM A(9), B(2)
+30 A = 7
+40 FOR I = 0 TO 9
+50 A(I) = I * I
+60 NEXT I
+70 PRINT A : " " : A(0) : " " : A(9) : " " : B(2)
+80 B(1) = A(3) + A(A(2))
+90 PRINT B(1)
+100 REM Sum through the elements in an expression
+110 S = 0
+120 FOR I = 0 TO 9
+130 S = S + A(I) * (I & 1)
+140 NEXT I
+150 PRINT S
+160 REM Indexes outside the array stop the program
+170 PRINT A(10)
+180 PRINT "not reached"
@@ -0,0 +1,3 @@
+10 INPUT A
+20 INPUT B
+30 PRINT A * B : " " : A + B
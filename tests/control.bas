@@ -0,0 +1,34 @@
+10 REM Nested loops, a step other than 1 and a counting down loop
+20 FOR I = 1 TO 3
+30 FOR J = 0 TO 4 STEP 2
+40 PRINT I * 10 + J : " " :
+50 NEXT J
+60 NEXT
+70 PRINT ""
+80 FOR K = 3 TO 1 STEP -1
+90 PRINT K :
+100 NEXT K
+110 PRINT ""
+120 REM The body runs once even past the limit
+130 FOR K = 5 TO 1
+140 PRINT "once " : K
+150 NEXT K
+160 REM Nested calls coming back after their line, a loop left inside is dropped
+170 A = 0
+180 GOSUB 300
+190 PRINT "back " : A
+200 FOR I = 1 TO 2
+210 GOSUB 400
+220 NEXT I
+230 PRINT "after " : I
+240 END
+300 A = A + 1
+310 GOSUB 350
+320 RETURN
+350 A = A * 10
+360 RETURN
+400 FOR J = 1 TO 5
+410 IF J = 2 THEN RETURN
+420 PRINT "sub " : I : " " : J
+430 NEXT J
+440 RETURN
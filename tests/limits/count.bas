@@ -0,0 +1,4 @@
+10 REM Takes a bit over 2000 lines
+20 A = A + 1
+30 IF A < 1000 THEN GOTO 20
+40 PRINT A
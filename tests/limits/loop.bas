@@ -0,0 +1,2 @@
+10 REM Never ends
+20 GOTO 20
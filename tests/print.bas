@@ -0,0 +1,6 @@
+10 REM Decimal, hex and binary numbers, the separators and the line feed left out
+20 PRINT 0 : " " : 7 : " " : -7 : " " : 1234567890 : " " : -2147483647
+30 PRINT HEX 255 : " " : HEX 0 : " " : HEX -1
+40 PRINT BIN 5 : " " : BIN 0 : " " : BIN 1024
+50 PRINT "no line feed" :
+60 PRINT " then " : 10 / 3 : " " : -10 / 3
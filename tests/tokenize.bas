@@ -0,0 +1,9 @@
+10 A = 1
+20 IF A=1THEN PRINT "then"
+30 FOR I=1TO 3STEP 2
+40 PRINT I
+50 NEXT I
+60 IF A=0x1THEN PRINT "hex"
+70 IF 2>1THEN GOTO 90
+80 PRINT "skipped"
+90 PRINT 0x1F+0b101
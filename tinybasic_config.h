@@ -0,0 +1,172 @@
+/**
+ * Copyright Lukasz Forenc 2023
+ *
+ * File: tinybasic_config.h
+ *
+ */
+
+/****************************************************************************/
+// Build profiles, selected with CONFIG_PC_FAST, CONFIG_AVR_SMALL or CONFIG_ESP8266
+// defined on the command line (see the Makefile targets). Everything that isn't
+// defined here gets the default from the config section of main.c.
+
+#if defined(CONFIG_PC_FAST)
+// PC with all the lookup tables, caches and fast paths, memory isn't a concern
+#define CODE_MEMORY_SIZE  65536
+#define EXPR_MAX_TOKENS   128
+#define LINE_INDEX        1
+#define GAP_BUFFER        1
+#define EXPR_RPN          1
+#define EXPR_CACHE_SIZE   1024
+#define EXPR_CACHE_POOL   16384
+#define STMT_CACHE_SIZE   1024
+#define RUN_THREADED      1
+#define CONTROL_STACK_SIZE 64
+#define OUTPUT_BUFFER_SIZE 4096
+#define BATCH_MODE        1
+#define PRINT_FORMAT      1
+
+#elif defined(CONFIG_AVR_SMALL)
+// ATmega328, everything that takes RAM is disabled and the output is sent by the TX interrupt
+#define NEWLINE           '\n'
+#define BACKSPACE         '\b'
+#define CODE_MEMORY_SIZE  512
+#define EXPR_MAX_TOKENS   24
+#define MAX_LINENUM       10000
+#define POKE_PEEK         1
+#define FILE_IO           0
+#define IO_KILL           1
+#define IO_KILL_INTERVAL  16
+#define OUTPUT_CRLF       1
+#define SHORT_STRING      1
+#define LOOPBACK          0
+#define LINE_INDEX        0
+#define GAP_BUFFER        0
+#define EXPR_RPN          1
+#define EXPR_CACHE_SIZE   0
+#define EXPR_CACHE_POOL   0
+#define STMT_CACHE_SIZE   0
+#define PROFILE           0
+#define BATCH_MODE        0
+#define BATCH_THREADS     0
+#define PRINT_FORMAT      0
+#define OUTPUT_BUFFER_SIZE 32
+#define OUTPUT_IRQ        1
+#define RUN_THREADED      1
+#define CONTROL_STACK_SIZE 8
+#define ARRAYS            1
+#define EXPR_CHECKED      0
+#define STEP_API          1
+#define STEP_SLICE        16
+#define RUN_LIMITS        0
+#define RUN_ANALYZER      1
+#define INPUT_BUFFER_SIZE 0
+#define STMT_FUSION       0
+#define STATS             0
+
+#define LINE_T            uint16_t
+#define VAR_T             int32_t
+#define UVAR_T            uint32_t
+#define PEEK_T            size_t
+
+// Benchmark builds of the profile run on the PC with their own IO
+#if !defined(BENCH) || BENCH == 0
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+#include <avr/io.h>
+
+#define IO_INIT() {              \
+  UBRR0 = F_CPU / 8 / 9600 - 1;  \
+  UCSR0A = 1<<U2X0;              \
+  UCSR0B = 1<<TXEN0 | 1<<RXEN0;  \
+  sei();                         \
+}
+
+#define PUTCHAR(x) {               \
+  while (!(UCSR0A & (1<<UDRE0)));  \
+  UDR0 = *x;                       \
+}
+
+#define GETCHAR(x) {              \
+  while (!(UCSR0A & (1<<RXC0)));  \
+  *x = UDR0;                      \
+}
+
+#define IO_CHECK(x) {           \
+  *x = !!(UCSR0A & (1<<RXC0));  \
+}
+
+#include <avr/interrupt.h>
+#define OUTPUT_START()    (UCSR0B |= 1<<UDRIE0)
+bool output_next(char *chr);
+ISR(USART_UDRE_vect) {
+  char chr;
+  if (output_next(&chr))
+    UDR0 = chr;
+  else
+    UCSR0B &= ~(1<<UDRIE0);
+}
+
+#define PROFILE_TICKS()   ((unsigned long)TCNT1)
+#endif
+
+#elif defined(CONFIG_ESP8266)
+// ESP8266 (and other Arduino boards) built as a sketch, the console is on the serial port
+#define NEWLINE           '\r'
+#define BACKSPACE         '\b'
+#define BACKSPACE_STR     "\b \b"
+#define CODE_MEMORY_SIZE  4096
+#define EXPR_MAX_TOKENS   48
+#define MAX_LINENUM       10000
+#define POKE_PEEK         0
+#define FILE_IO           0
+#define IO_KILL           1
+#define IO_KILL_INTERVAL  256
+#define OUTPUT_CRLF       1
+#define SHORT_STRING      1
+#define LOOPBACK          1
+#define LINE_INDEX        0
+#define GAP_BUFFER        0
+#define EXPR_RPN          1
+#define EXPR_CACHE_SIZE   0
+#define EXPR_CACHE_POOL   0
+#define STMT_CACHE_SIZE   0
+#define PROFILE           0
+#define BATCH_MODE        0
+#define BATCH_THREADS     0
+#define PRINT_FORMAT      0
+#define OUTPUT_BUFFER_SIZE 64
+#define OUTPUT_IRQ        0
+#define RUN_THREADED      1
+#define CONTROL_STACK_SIZE 8
+#define ARRAYS            1
+#define EXPR_CHECKED      0
+#define STEP_API          1
+#define STEP_SLICE        64
+#define RUN_LIMITS        1
+#define RUN_ANALYZER      1
+#define INPUT_BUFFER_SIZE 0
+#define STMT_FUSION       0
+#define STATS             1
+
+#define LINE_T            uint16_t
+#define VAR_T             int32_t
+#define UVAR_T            uint32_t
+#define PEEK_T            size_t
+
+#if !defined(BENCH) || BENCH == 0
+#define IO_INIT()         (Serial.begin(115200))
+#define PUTCHAR(x)        (Serial.write(*x))
+#define GETCHAR(x)        { while (!Serial.available()); *x = Serial.read(); }
+#define IO_CHECK(x)       (*x = Serial.available())
+#define FLUSH(x, n)       (Serial.write(x, n))
+#define PROFILE_TICKS()   (micros())
+#define RUN_CLOCK()       (millis())
+#define IDLE()            (delay(1))
+#endif
+#endif
+
+// Local overrides go here
+
+/****************************************************************************/